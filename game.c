@@ -1,235 +1,6593 @@
+#include <dirent.h>  // Обход каталога с шаблонами в режиме бенчмарка
+#include <errno.h>   // EINTR — сон до срока кадра прерван сигналом
 #include <ncurses.h>  // Библиотека для работы с терминалом (отображение и обработка клавиш)
+#include <pthread.h>  // Потоки пула и барьеры между поколениями
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>  // Векторные инструкции SSE2/AVX2
+#define HAVE_X86_SIMD 1
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>  // perf_event_open — аппаратные счётчики профиля (--profile)
+#include <sys/syscall.h>
+#define HAVE_PERF_EVENTS 1
+#endif
+#include <stdatomic.h>  // Тройной буфер кадров между потоком симуляции и интерфейсом
+#include <stdint.h>  // Для 64-битных слов битового поля
 #include <stdio.h>  // Для стандартного ввода-вывода, freopen, fprintf, fgets, getchar
 #include <stdlib.h>  // Для функций динамического выделения памяти  malloc, free
+#include <string.h>  // Для strcmp при разборе аргументов командной строки
+#include <fcntl.h>         // open — входной файл отображается в память
+#include <sys/mman.h>      // mmap — чтение входного файла без копирования
+#include <sys/resource.h>  // getrusage — пиковая память в бенчмарке
+#include <sys/wait.h>      // waitpid — завершение процессов-рангов
+#include <malloc.h>        // malloc_trim — память прочитанной полосы не должна уйти в ранги
+#include <sched.h>         // sched_yield — ожидание строк соседнего ранга
+#include <signal.h>        // kill — остановка рангов, если один из них упал
+#include <sys/stat.h>      // fstat — размер входного файла
+#include <unistd.h>        // read, close
+#include <time.h>          // clock_gettime — замер времени в бенчмарке
 
-#define WIDTH 80   // Ширина игрового поля в клетках
-#define HEIGHT 25  // Высота игрового поля в клетках
-#define INIT_SPEED 200000  // Начальная задержка между кадрами (в микросекундах)
+#define FRAME_RATE 30      // Кадров интерфейса в секунду (кадры идут по абсолютным срокам)
+#define FRAME_HISTORY 256  // Длительностей последних кадров для p50/p99 в строке состояния
+#define INIT_RATE 5        // Начальная цель скорости в поколениях в секунду (умножается на 2^jump)
+#define MAX_RATE (1ull << 62)  // Наибольшая цель скорости (клавиша Z)
+#define MAX_PER_FRAME (1ull << 40)  // Наибольшее число поколений на кадр (клавиша X)
+#define DEFAULT_WIDTH 80   // Наименьшая ширина поля для форматов RLE и .cells без --size
+#define DEFAULT_HEIGHT 25  // Наименьшая высота поля для форматов RLE и .cells без --size
+#define MAX_SIDE 1048576   // Наибольшая допустимая сторона поля в клетках
+#define MAX_THREADS 256    // Наибольшее число потоков расчёта
+#define MAX_RANKS 256      // Наибольшее число процессов-рангов (--ranks)
+#define RANK_SLOTS 4       // Строк в кольце между соседними рангами (на столько поколений ранг уходит вперёд)
+#define HL_MAX_LEVEL 60    // Наибольший уровень макроячейки Hashlife (сторона 2^60 клеток)
+#define HL_BLOCK 4096      // Узлов Hashlife в одном блоке памяти
+#define HL_GC_NODES (1 << 22)  // Число узлов Hashlife, после которого запускается сборка мусора
+#define TILE_ROWS 16       // Высота плитки движка tiles в строках (ширина — одно слово, 64 клетки)
+#define TEMPORAL_MAX 64    // Наибольший временной блок (--temporal-k): боковая рамка плитки — одно слово
+#define TEMPORAL_WORDS 32  // Ширина плитки временного блока в словах (2048 клеток) без рамки
+#define CHUNK_SIDE 64      // Сторона участка движка chunks в клетках (строка участка — одно слово)
+#define DISK_MAGIC "GOLDISK1"  // Сигнатура файла доски движка disk
+#define DISK_HEADER 40         // Размер заголовка доски в байтах (под заголовок отведена страница)
+#define DISK_BAND (1 << 22)    // Байт в полосе движка disk: полоса — единица предвыборки и записи
+#define DISK_BEHIND 4          // Полос, ждущих записи на диск (дальше счёт ждёт поток записи)
+#define BENCH_MIN_TIME 0.5  // Минимальное время замера одного случая бенчмарка в секундах
+#define BENCH_SEED 20250707ull  // Зерно случайных полей бенчмарка (результаты воспроизводимы)
+#define BENCH_MAX_GENS (1ull << 40)  // Предел поколений одного замера (Hashlife иначе уходит за 2^60)
+#define SOUP_SIDE 16          // Сторона случайного супа поиска (--soup), доля живых клеток — 1/2
+#define SOUP_MAX_GENS 16384   // Суп, не успокоившийся за столько поколений, считается нестабильным
+#define SOUP_MAX_POP 100000   // Суп, выросший больше, — тоже (правило с неограниченным ростом)
+#define SOUP_MAX_PERIOD 60    // Наибольший период, который ищется у супа и у объектов переписи
+#define SOUP_HISTORY 256      // Кольцо населённостей супа для поиска периода (не меньше 4 периодов)
+#define SOUP_OBJECT_SIDE 64   // Объект переписи шире или выше этого — «messy» (строка объекта — слово)
+#define SOUP_KEY 1200         // Наибольшая длина ключа объекта переписи с завершающим нулём
 
-// Создаём двумерное поле размером HEIGHT x WIDTH, выделяем динамически память
-int **create_field() {
-    int **field = malloc(HEIGHT * sizeof(int *));  // Массив указателей на строки
-    int success = 1;  // Флаг успешного выделения памяти
+#define PROFILE_INTERVAL 1.0  // Интервал строк трассы профиля в секундах
 
-    if (field) {  // Проверяем, что выделение прошло успешно
-        for (int i = 0; i < HEIGHT && success; i++) {  // Для каждой строки
-            field[i] = malloc(WIDTH * sizeof(int));    // Выделяем память под строку
-            if (!field[i]) success = 0;  // Если выделение не удалось — ставим ошибку
+#define CYCLE_HISTORY 64  // Хешей последних поколений в кольце поиска циклов (периоды до 64 — сразу)
+
+#define CKPT_MAGIC "GOLCKPT1"  // Сигнатура файла контрольной точки
+#define CKPT_HEADER 40         // Размер заголовка контрольной точки в байтах
+#define STREAM_MAGIC "GOLSTRM1"  // Сигнатура файла записи эволюции
+#define STREAM_END "GOLSTEND"    // Сигнатура хвоста записи с индексом ключевых кадров
+#define STREAM_HEADER 24         // Размер заголовка записи в байтах
+#define RECORD_KEYFRAME 1024     // Период ключевых кадров записи по умолчанию (--keyframe-every)
+#define RECORD_BLOCK (1 << 20)   // Размер блока, которым запись уходит потоку записи
+#define RECORD_QUEUE 64          // Блоков в очереди записи (дальше симуляция ждёт диск)
+#define EXPORT_WORKERS 16        // Наибольшее число потоков кодирования кадров (--export-threads)
+#define EXPORT_DEPTH 2           // Кадров в очереди экспорта на поток кодирования (дальше симуляция ждёт)
+#define EXPORT_GIF_DELAY 4       // Пауза между кадрами GIF в сотых долях секунды (25 кадров в секунду)
+#define EXPORT_GIF_SIDE 65535    // Наибольшая сторона изображения GIF в пикселях
+#define EXPORT_STORED 65535      // Наибольший несжатый блок deflate в PNG
+#define LIFE_BIRTH (1u << 3)                  // Маска рождения правила Конвея (B3): бит n — n соседей
+#define LIFE_SURVIVE ((1u << 2) | (1u << 3))  // Маска выживания правила Конвея (S23)
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))  // Встраивание ядра с константными масками
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define VECTORIZE __attribute__((optimize("tree-vectorize")))  // Векторизация цикла и при -O2
+#else
+#define VECTORIZE
+#endif
+
+#define CACHE_LINE 64  // Выравнивание буферов и шаг строк — по линии кэша (кратно регистрам AVX2)
+
+// Форматы входного файла
+enum { FORMAT_GRID, FORMAT_RLE, FORMAT_CELLS, FORMAT_CHECKPOINT, FORMAT_STREAM, FORMAT_DISK };
+
+// Кодирование тела контрольной точки: строки по (width + 7) / 8 байт, клетка j — бит j % 8 байта j / 8
+enum { CKPT_RAW, CKPT_PACKBITS };
+
+// Кадры записи эволюции: байт типа, длина данных варинтом (LEB128) и данные.
+// Ключевой кадр — номер поколения и всё поле в PackBits (строки как у контрольной точки);
+// разностный — следующее поколение: серии изменившихся клеток парами варинтов (отступ от конца
+// предыдущей серии, длина - 1) в порядке i * width + j; повтор — сколько поколений поле не менялось;
+// индекс — последнее поколение и пары (поколение, смещение) ключевых кадров, за ним 8 байт смещения
+// индекса и STREAM_END
+enum { REC_KEY = 'K', REC_DELTA = 'D', REC_SAME = 'S', REC_INDEX = 'I' };
+
+// Движки расчёта поколений
+enum { ENGINE_REF, ENGINE_BITS, ENGINE_SIMD, ENGINE_HASHLIFE, ENGINE_TILES, ENGINE_HALO, ENGINE_CHUNKS,
+       ENGINE_DISK, ENGINE_COUNT };
+
+// Имена движков для --engine и отчётов, в порядке ENGINE_*
+const char *engine_names[ENGINE_COUNT] = {"ref", "bits", "simd", "hashlife", "tiles", "halo", "chunks",
+                                          "disk"};
+
+// Граница поля: тор (края склеены), мёртвая рамка, отражение (за краем — копия крайней клетки)
+enum { BOUNDARY_TORUS, BOUNDARY_DEAD, BOUNDARY_REFLECT, BOUNDARY_COUNT };
+
+// Имена границ для --boundary, в порядке BOUNDARY_*
+const char *boundary_names[BOUNDARY_COUNT] = {"torus", "dead", "reflect"};
+
+// Правило клеточного автомата Bx/Sy: бит n маски birth — мёртвая клетка с n соседями оживает,
+// бит n маски survive — живая клетка с n соседями выживает
+typedef struct {
+    unsigned birth;  // Маска рождения
+    unsigned survive;  // Маска выживания
+    unsigned char born[16];  // Следующее состояние мёртвой клетки по числу соседей (16 байт — для pshufb)
+    unsigned char keep[16];  // Таблица следующего состояния живой клетки по числу соседей
+} rule;
+
+// Правило, по которому считают все движки. По умолчанию — B3/S23 Конвея, другое ставит rule_init
+rule life_rule = {LIFE_BIRTH, LIFE_SURVIVE, {0, 0, 0, 1}, {0, 0, 1, 1}};
+
+// Параметры запуска программы
+typedef struct {
+    const char *input;  // Имя файла с начальным состоянием поля
+    int engine;         // Выбранный движок расчёта поколений
+    int height;         // Высота поля из --size (0 — взять из файла)
+    int width;          // Ширина поля из --size (0 — взять из файла)
+    int threads;        // Число потоков расчёта (--threads)
+    int jump;           // Каждый кадр продвигает поле на 2^jump поколений (--jump)
+    long long generations;  // Число поколений в пакетном режиме (--generations, -1 — интерактивный режим)
+    const char *output;     // Файл для итогового поля в пакетном режиме (--output, NULL — stdout)
+    int engine_given;       // Движок задан явно (бенчмарк тогда меряет только его)
+    int threads_given;      // Число потоков задано явно (поиск по супам иначе берёт все процессоры)
+    int bench;              // Режим бенчмарка (--bench), input — каталог с шаблонами
+    int boundary;           // Граница поля (--boundary, BOUNDARY_*)
+    rule rule;              // Правило из --rule
+    int rule_given;         // Правило задано явно (иначе — из файла RLE или контрольной точки, либо B3/S23)
+    const char *checkpoint;      // Файл контрольной точки (--checkpoint, NULL — не сохранять)
+    long long checkpoint_every;  // Период контрольных точек в поколениях (0 — только при завершении)
+    const char *stats;           // Файл потока статистики (--stats, NULL — не писать)
+    long long stats_every;       // Пишем статистику каждого stats_every-го поколения (--stats-every)
+    const char *record;          // Файл или канал записи эволюции (--record, NULL — не писать)
+    long long keyframe_every;    // Период ключевых кадров записи в поколениях (--keyframe-every)
+    long long seek;              // Поколение записи, с которого начинаем (--seek, -1 — последнее)
+    int ranks;                   // Процессов-рангов пакетного режима (--ranks, 0 — считаем в этом процессе)
+    long long soup;              // Случайных супов поиска (--soup, 0 — не искать)
+    uint64_t seed;               // Зерно поиска (--seed): суп i зависит только от него и от i
+    const char *disk;            // Файл доски движка disk (--disk, NULL — временный файл)
+    int temporal_k;              // Поколений за проход плиток битового движка (--temporal-k, 1 — без блоков)
+    const char *profile;         // Трасса профиля фаз (--profile, NULL — профиль выключен)
+    const char *export;          // Кадры экспорта: .ppm, .png или анимация .gif (--export, NULL — нет)
+    int export_format;           // Формат экспорта (EXPORT_*) по расширению файла
+    long long export_every;      // Период кадров экспорта (--export-every, 0 — каждое поколение)
+    int export_scale;            // Пикселей на сторону клетки (--scale N)
+    int export_shrink;           // Клеток на сторону пикселя (--scale 1/N)
+    int export_threads;          // Потоков кодирования кадров (--export-threads, 0 — по числу процессоров)
+} options;
+
+// Входной файл, отображённый в память, с уже определёнными форматом и размерами узора
+typedef struct {
+    char *data;    // Содержимое файла
+    size_t size;   // Размер содержимого в байтах
+    int mapped;    // 1 — data получено через mmap, 0 — прочитано в malloc-буфер (каналы и т. п.)
+    int format;    // Формат файла (FORMAT_*)
+    int height;    // Высота узора в файле
+    int width;     // Ширина узора в файле
+    const char *body;  // Начало данных узора (после комментариев и заголовка)
+    size_t body_size;  // Размер тела контрольной точки или кадров записи (без индекса) в байтах
+    int encoding;      // Кодирование тела контрольной точки (CKPT_*)
+    uint64_t generation;  // Номер поколения, с которого продолжается счёт (контрольная точка, запись)
+    uint64_t first_generation;    // Первое поколение записи
+    const unsigned char *index;   // Данные кадра индекса записи (NULL — записи без хвоста ищем подряд)
+    size_t index_size;
+    rule rule;            // Правило из заголовка RLE или контрольной точки
+    int has_rule;         // Файл задаёт правило
+} board_file;
+
+// Игровое поле: все строки в одном выровненном буфере, строка i начинается с cells + i * stride
+typedef struct {
+    int height;            // Высота поля в клетках
+    int width;             // Ширина поля в клетках
+    int stride;            // Шаг строки в байтах, кратный CACHE_LINE
+    unsigned char *cells;  // Клетки (0 или 1), хвосты строк за width не используются
+} field;
+
+#define CELL(f, i, j) ((f)->cells[(size_t)(i) * (f)->stride + (j)])  // Клетка (i, j) поля f
+
+// Битовое поле: 64 клетки в одном машинном слове, строки лежат подряд
+typedef struct {
+    int height;      // Высота поля в клетках
+    int width;       // Ширина поля в клетках
+    int words;       // Количество 64-битных слов в одной строке
+    uint64_t tail;   // Маска значимых битов последнего слова строки
+    uint64_t *bits;  // Слова всех строк подряд (height * words)
+} bitfield;
+
+// Макроячейка Hashlife: квадрат 2^level x 2^level клеток. Одинаковые квадраты хранятся
+// в единственном экземпляре (hash-consing), поэтому запомненный результат переиспользуется
+typedef struct hl_node {
+    struct hl_node *nw, *ne, *sw, *se;  // Четверти уровня level - 1 (NULL у отдельных клеток)
+    struct hl_node *result;  // Центр уровня level - 1 через 2^rstep поколений (NULL — не вычислен)
+    struct hl_node *hnext;   // Следующий узел в цепочке хеш-таблицы или в списке свободных
+    uint64_t population;     // Число живых клеток в квадрате
+    int level;               // Уровень узла (-1 — узел свободен)
+    int rstep;               // log2 числа поколений, на которое вычислен result
+    unsigned mark;           // Отметка сборки мусора
+} hl_node;
+
+// Блок памяти под узлы Hashlife
+typedef struct hl_block {
+    struct hl_block *next;  // Следующий блок
+    hl_node nodes[HL_BLOCK];
+} hl_block;
+
+// Вселенная Hashlife: бесконечная плоскость, на которой живёт квадродерево с корнем root
+typedef struct {
+    hl_node **table;                   // Хеш-таблица уникальных узлов (цепочки через hnext)
+    size_t buckets;                    // Число корзин (степень двойки)
+    size_t count;                      // Число узлов в таблице
+    size_t limit;                      // Порог числа узлов для сборки мусора
+    hl_block *blocks;                  // Все выделенные блоки узлов
+    hl_node *free_list;                // Свободные узлы
+    hl_node leaf[2];                   // Мёртвая и живая клетки (уровень 0)
+    hl_node *empty[HL_MAX_LEVEL + 1];  // Пустые квадраты каждого уровня
+    hl_node *root;                     // Корень текущего поколения
+    int64_t top;                       // Строка левого верхнего угла корня на плоскости
+    int64_t left;                      // Столбец левого верхнего угла корня на плоскости
+    int step;                          // log2 шага, на который сейчас считаются результаты
+    unsigned epoch;                    // Номер текущей сборки мусора
+} hashlife;
+
+// Разбиение битового поля на плитки TILE_ROWS x 64 с отметками изменений. Плитка
+// пересчитывается, только если она или её соседка изменилась на прошлом шаге
+typedef struct {
+    int rows;          // Число плиток по вертикали
+    int cols;          // Число плиток по горизонтали (= словам в строке)
+    int *changed;      // Номера плиток, изменившихся на последнем шаге
+    int nchanged;      // Их количество
+    int *work;         // Плитки, которые нужно пересчитать на текущем шаге
+    unsigned *stamp;   // Номер шага, на котором плитка попала в work (защита от повторов)
+    unsigned epoch;    // Номер текущего шага
+    long long active;  // Сколько плиток пересчитано на последнем шаге
+    int track;                 // Сводки плиток ведутся (с первого шага, которому нужна статистика)
+    unsigned short *pop;       // Живых клеток в плитке; сводки обновляются при пересчёте плитки,
+    unsigned short *row_mask;  // маска её непустых строк
+    uint64_t *col_mask;        // и маска непустых столбцов (OR её слов) — по ним считается статистика поля
+} tileset;
+
+// Участок бесконечной плоскости движка chunks: CHUNK_SIDE x CHUNK_SIDE клеток в двух поколениях.
+// Клетка (y, x) плоскости лежит в участке (floor(y / 64), floor(x / 64)), бит x mod 64 строки y mod 64
+typedef struct {
+    int64_t cy;                    // Координаты участка в участках
+    int64_t cx;
+    int empty;                     // Участок опустел на последнем шаге (будет освобождён)
+    uint64_t rows[2][CHUNK_SIDE];  // Строки участка в двух поколениях; текущее — rows[chunkmap.cur]
+} chunk;
+
+// Бесконечная плоскость из участков в хеш-таблице по их координатам. Участок создаётся, когда к его
+// краю подходят живые клетки, и освобождается, когда пустеет, — память следует за населением,
+// а не за заранее выбранной рамкой
+typedef struct {
+    chunk **table;    // Хеш-таблица участков: открытая адресация с линейным пробированием
+    size_t buckets;   // Размер таблицы (степень двойки, заполнена не больше чем наполовину)
+    chunk **list;     // Все участки подряд — для обхода
+    size_t count;     // Число участков
+    size_t capacity;  // Размер list
+    int cur;          // Индекс текущего поколения в rows участков
+} chunkmap;
+
+// Доска движка disk для полей больше памяти: оба поколения — битовые поля в файле, отображённом
+// в память. Поколение считается полосами во всю ширину (полоса — непрерывный кусок файла): перед
+// полосой счёт просит ОС заранее прочитать следующую, а готовые полосы поток записи сбрасывает
+// на диск и выталкивает из памяти вместе с уже ненужными полосами прошлого поколения. В памяти
+// живут лишь несколько полос, сколько бы ни занимало поле
+typedef struct {
+    int fd;                  // Файл доски
+    unsigned char *map;      // Отображение файла: страница заголовка, затем два поколения
+    size_t size;             // Размер файла в байтах
+    size_t page;             // Размер страницы: границы сброса и вытеснения выравниваются по ней
+    bitfield plane[2];       // Поколения прямо в отображении; текущее — plane[cur]
+    int cur;
+    int band;                // Строк в полосе
+    int bands;               // Полос в поколении
+    int top;                 // Куда disk_load ставит узор, прочитанный в поле своего размера
+    int left;
+    pthread_t writer;        // Поток отложенной записи
+    pthread_mutex_t lock;    // Защищает счётчики и флаги ниже
+    pthread_cond_t wake;     // Готова новая полоса или пора выходить
+    pthread_cond_t done;     // Поток записи закончил полосу
+    int queued;              // Полос текущего шага, посчитанных и отданных потоку записи
+    int flushed;             // Из них записанных и вытесненных
+    int stop;                // Поток записи должен выйти
+    int failed;              // Сброс полосы на диск не удался
+    int resumed;             // Файл уже был доской этого размера: счёт продолжается с её поколения
+    uint64_t generation;     // Поколение продолжаемой доски
+} disk_board;
+
+// Статистика поколения. Движки считают её тем же проходом по строкам, что и само поколение:
+// строка ещё в кэше, второго обхода поля нет
+typedef struct {
+    uint64_t population;  // Живых клеток
+    int64_t births;       // Родилось на шаге к этому поколению (-1 — неизвестно)
+    int64_t deaths;       // Умерло на шаге к этому поколению (-1 — неизвестно)
+    int64_t top;          // Рамка живых клеток включительно (при population == 0 не определена)
+    int64_t left;
+    int64_t bottom;
+    int64_t right;
+} gen_stats;
+
+// Поток статистики поколений в CSV или JSON Lines
+typedef struct {
+    const char *path;  // Файл потока ("-" — stdout)
+    FILE *out;
+    int json;          // 1 — JSON Lines (файл .json или .jsonl), 0 — CSV
+    uint64_t every;    // Пишем поколения, кратные every
+} stats_stream;
+
+// Запись эволюции: ключевые кадры целиком, между ними — только изменившиеся клетки. Кадры кодирует
+// поток симуляции, в блоки по RECORD_BLOCK; на диск или в канал их пишет свой поток, так что медленный
+// приёмник не тормозит счёт, пока очередь не заполнится
+typedef struct {
+    const char *path;        // Файл записи ("-" — stdout)
+    FILE *out;
+    pthread_t thread;        // Поток записи
+    pthread_mutex_t lock;    // Защищает очередь и флаги ниже
+    pthread_cond_t changed;  // В очереди появился блок, освободилось место или запись закрывается
+    unsigned char *queue[RECORD_QUEUE];  // Готовые блоки по кругу, начиная с head
+    size_t queue_size[RECORD_QUEUE];     // Их заполненные размеры
+    int head;                // Первый блок очереди
+    int count;               // Блоков в очереди
+    int closing;             // Новых блоков не будет: поток записи дописывает очередь и выходит
+    int failed;              // Запись не удалась (сообщаем при закрытии)
+    unsigned char *block;    // Заполняемый блок
+    size_t used;             // Занято в нём
+    size_t size;             // Его размер
+    unsigned char *frame;    // Данные кодируемого кадра
+    size_t frame_size;       // Размер буфера frame
+    unsigned char *raw;      // Поле ключевого кадра: строки по (width + 7) / 8 байт
+    bitfield *prev;          // Последнее записанное поколение — с ним сравнивается следующее
+    bitfield *pack;          // Поколение небитовых движков, упакованное для сравнения
+    uint64_t generation;     // Его номер
+    uint64_t same;           // Поколений без изменений, ещё не записанных кадром повтора
+    uint64_t keyframe_every;  // Период ключевых кадров
+    uint64_t offset;         // Смещение в файле следующего кадра
+    uint64_t *keys;          // Пары (поколение, смещение) ключевых кадров для индекса
+    size_t nkeys;            // Число пар
+    size_t keys_cap;         // Размер keys в парах
+} recorder;
+
+// Форматы экспорта: кадр PPM (P6) или PNG в отдельный файл на поколение либо кадры одного GIF
+enum { EXPORT_PPM, EXPORT_PNG, EXPORT_GIF };
+
+// Состояния кадра в очереди экспорта
+enum { SLOT_FREE, SLOT_QUEUED, SLOT_BUSY, SLOT_DONE };
+
+// Кадр очереди экспорта: снимок поколения и, когда поток кодирования закончит, готовый файл или
+// кусок GIF
+typedef struct {
+    int state;            // SLOT_*
+    uint64_t generation;  // Поколение кадра
+    bitfield *cells;      // Снимок поля
+    unsigned char *data;  // Закодированный кадр
+    size_t size;          // Его размер
+    size_t cap;           // Размер буфера data
+} export_slot;
+
+// Экспорт кадров. Поток симуляции только копирует поле в свободный кадр очереди; кодируют кадры потоки
+// пула, каждый свой, а пишет их по порядку поколений отдельный поток записи. Симуляция ждёт, только
+// когда все кадры очереди заняты
+typedef struct {
+    const char *path;       // Файл GIF или образец имён файлов кадров
+    int format;             // EXPORT_*
+    int scale;              // Пикселей на сторону клетки
+    int shrink;             // Клеток на сторону пикселя
+    int image_height;       // Размер изображения в пикселях
+    int image_width;
+    uint64_t every;         // Пишем поколения, кратные every
+    FILE *out;              // Файл GIF (кадры PPM и PNG открываются по одному)
+    pthread_t *workers;     // Потоки кодирования
+    int nworkers;
+    pthread_t writer;       // Поток записи
+    pthread_mutex_t lock;   // Защищает состояния кадров, счётчики и флаги ниже
+    pthread_cond_t changed;  // Кадр поменял состояние или экспорт закрывается
+    export_slot *slots;     // Очередь кадров по кругу: кадр n лежит в slots[n % depth]
+    int depth;
+    uint64_t submitted;     // Кадров отдано в очередь
+    uint64_t taken;         // Из них взято на кодирование
+    uint64_t written;       // Из них записано
+    int closing;            // Новых кадров не будет
+    int failed;             // Кодирование или запись не удались (сообщаем при закрытии)
+    bitfield *pack;         // Поколение небитовых движков, упакованное для снимка
+} exporter;
+
+// Ядро одной строки: по трём расширенным строкам (клетка j лежит в байте j + 1) считает out[0..n)
+typedef void (*life_row_fn)(const unsigned char *up, const unsigned char *mid, const unsigned char *down,
+                            unsigned char *out, int n);
+
+// Ядра битового движка: вся строка out[0..words) или одно слово k по строкам up, mid, down
+typedef void (*bits_row_fn)(const uint64_t *up, const uint64_t *mid, const uint64_t *down, uint64_t *out,
+                            int words, int width);
+typedef uint64_t (*bits_word_fn)(const uint64_t *up, const uint64_t *mid, const uint64_t *down, int k,
+                                 int words, int width);
+
+struct engine;
+
+// Аргумент потока пула: движок и номер полосы строк, которую поток считает
+typedef struct {
+    struct engine *e;  // Общий движок
+    int index;         // Номер потока (0 — главный поток)
+} worker_arg;
+
+// Движок расчёта вместе с буферами двух поколений
+typedef struct engine {
+    int type;              // Тип движка (ENGINE_*)
+    field *curr;           // Текущее поколение эталонного и векторного движков, оно же поле для отрисовки
+    field *next;           // Следующее поколение; буферы переиспользуются и не очищаются между шагами
+    bitfield *bcurr;       // Поколения битового движка
+    bitfield *bnext;
+    unsigned char *line;   // Три расширенные строки векторного движка на каждый поток
+    hashlife *hl;          // Вселенная движка Hashlife
+    tileset *tiles;        // Плитки движка tiles
+    chunkmap *chunks;      // Участки движка chunks
+    disk_board *disk;      // Доска движка disk в файле
+    field *gcurr;          // Поколения движка halo: (height + 2) x (width + 2) с рамкой призрачных клеток
+    field *gnext;
+    int boundary;          // Граница поля (BOUNDARY_*), её понимают движки ref и halo
+    int threads;           // Число потоков расчёта, включая главный
+    int temporal;          // Поколений за один проход плиток битового движка (--temporal-k, 1 — по одному)
+    int block;             // Поколений текущего шага engine_step (больше 1 — временной блок)
+    uint64_t *tblock;      // Буферы плиток временных блоков, temporal_words на поток
+    pthread_t *workers;    // Постоянные потоки пула (threads - 1 штук), живут всё время работы
+    worker_arg *args;      // Аргументы потоков пула
+    pthread_barrier_t start;  // Барьер начала поколения: все потоки берут свою полосу
+    pthread_barrier_t done;   // Барьер конца поколения: после него поля можно менять местами
+    int stop;              // Флаг завершения потоков пула
+    uint64_t generation;   // Номер текущего поколения (с учётом восстановленной контрольной точки)
+    gen_stats stats;       // Статистика поколения stats_gen
+    uint64_t stats_gen;    // Поколение, для которого посчитана stats (UINT64_MAX — ни для какого)
+    gen_stats *band;       // Статистика полос каждого потока на текущем шаге
+    int stats_want;        // Считать статистику на текущем шаге
+    int stats_last;        // Считать статистику на последнем шаге каждого engine_advance (интерфейс)
+    stats_stream *stream;  // Поток статистики (NULL — не пишется)
+    recorder *record;      // Запись эволюции (NULL — не пишется)
+    exporter *export;      // Экспорт кадров (NULL — не пишется)
+} engine;
+
+// Окно просмотра поля в терминале и последний выведенный кадр: на экран уходят только изменения
+typedef struct {
+    int top;     // Строка поля в левом верхнем углу экрана
+    int left;    // Столбец поля в левом верхнем углу экрана
+    int zoom;    // Клеток поля на символ экрана по каждой оси (1 — без масштаба, степень двойки)
+    int rows;    // Размер кадра в prev: строки и столбцы экрана под полем
+    int cols;
+    char *prev;  // Последний выведенный кадр rows x cols ('\0' — символ ещё не выводился)
+    char *line;  // Строка кадра, которая строится перед сравнением с prev
+} view;
+
+// Поиск циклов по хешам поколений. Короткие периоды (до CYCLE_HISTORY) находятся по кольцу последних
+// хешей в первом же повторе, длинные — по алгоритму Брента: хеш-якорь переставляется на поколениях
+// с номерами 2^k - 1 от начала поиска, и цикл длины p находится не позже чем через 2p поколений
+// после входа в него
+typedef struct {
+    uint64_t ring[CYCLE_HISTORY];  // Хеши последних поколений, поколение g — в ring[g % CYCLE_HISTORY]
+    uint64_t seen;                 // Сколько поколений уже учтено
+    uint64_t anchor;               // Хеш-якорь Брента
+    uint64_t anchor_gen;           // Его поколение
+    uint64_t period;               // Найденный период (0 — цикл не найден)
+    uint64_t found;                // Поколение, на котором цикл найден
+    int empty;                     // Поле вымерло
+} cycle_finder;
+
+#define FRAME_FRESH 4  // Флаг в triple_buffer.middle: средний буфер ещё не забран интерфейсом
+
+// Тройной буфер кадров без блокировок: поток симуляции пишет в back и меняет его местами со средним,
+// интерфейс забирает средний в front, только если там новый кадр. Никто не ждёт другого
+typedef struct {
+    field *slot[3];       // Три буфера кадра
+    uint64_t gen[3];      // Номер поколения в каждом буфере
+    gen_stats stats[3];   // Статистика поколения в каждом буфере
+    _Atomic int middle;   // Индекс среднего буфера | FRAME_FRESH
+    int back;             // Буфер, который заполняет поток симуляции
+    int front;            // Буфер, который рисует интерфейс
+} triple_buffer;
+
+// Кольцо строк от одного ранга к соседнему в общей памяти: пишет только отправитель, читает только
+// получатель, поэтому хватает двух счётчиков без блокировок. Счётчики — на разных линиях кэша
+typedef struct {
+    _Atomic uint64_t head;  // Строк записано
+    char pad_head[CACHE_LINE - sizeof(uint64_t)];
+    _Atomic uint64_t tail;  // Строк прочитано
+    char pad_tail[CACHE_LINE - sizeof(uint64_t)];
+} rank_ring;
+
+// Замеры одного ранга: где он проводит время — в счёте своей полосы или в обмене краями с соседями
+typedef struct {
+    int first;        // Полоса ранга: строки [first, last)
+    int last;
+    double compute;   // Счёт строк полосы, с
+    double exchange;  // Отправка и ожидание краёв соседей, с
+} rank_timing;
+
+// Общая память рангов (MAP_SHARED, создаётся до fork): кольца, замеры и очередь вывода.
+// У ранга r два исходящих кольца: rings[2r] несёт его последнюю строку нижнему соседу,
+// rings[2r + 1] — первую строку верхнему; соседи берутся по кругу, как на торе
+typedef struct {
+    int ranks;             // Число рангов
+    int width;             // Ширина поля в клетках
+    int words;             // Слов в строке
+    uint64_t tail;         // Маска значимых битов последнего слова строки
+    rank_ring *rings;      // 2 * ranks колец
+    uint64_t *slots;       // Строки колец: кольцо k — RANK_SLOTS строк с slots + k * RANK_SLOTS * words
+    rank_timing *timing;   // Замеры рангов
+    _Atomic int *turn;     // Ранг, который сейчас пишет свою полосу в итоговое поле
+    FILE *out;             // Итоговое поле (открыто родителем, буфер пуст к моменту fork)
+    void *base;            // Начало общей памяти
+    size_t size;           // Её размер
+} rank_world;
+
+// Запись контрольных точек фоновым потоком: главный поток только упаковывает снимок в биты,
+// сжатие и запись на диск идут параллельно со счётом следующих поколений
+typedef struct {
+    const char *path;     // Файл контрольной точки (пишется через path.tmp и rename)
+    pthread_t thread;     // Поток записи
+    int running;          // Поток записи запущен и ещё не присоединён
+    int failed;           // Запись не удалась; после этого новые точки не пишутся, флаг не сбрасывается
+    unsigned char *raw;   // Снимок поля: строки по (width + 7) / 8 байт
+    size_t raw_size;      // Размер снимка в байтах
+    int height;           // Размеры поля снимка
+    int width;
+    uint64_t generation;  // Номер поколения снимка
+} checkpoint;
+
+// Фазы профиля: разбор входного файла, шаги движка, отрисовка кадра, вывод итогового поля
+enum { PHASE_READ, PHASE_STEP, PHASE_DRAW, PHASE_WRITE, PHASE_COUNT };
+
+// Имена фаз для сводки и трассы, в порядке PHASE_*
+const char *phase_names[PHASE_COUNT] = {"read", "step", "draw", "write"};
+
+// Аппаратные счётчики профиля
+enum { COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_CACHE_MISSES, COUNTER_BRANCH_MISSES, COUNTER_COUNT };
+
+// Имена счётчиков для трассы, в порядке COUNTER_*
+const char *counter_names[COUNTER_COUNT] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+// Накопленное время и счётчики фазы
+typedef struct {
+    uint64_t calls;                   // Сколько раз фаза выполнялась
+    double seconds;                   // Время по настенным часам
+    uint64_t counts[COUNTER_COUNT];   // Аппаратные события
+} phase_total;
+
+// Профиль (--profile): итоги фаз за всё время — в сводку при выходе, за каждый интервал — в трассу
+typedef struct {
+    int enabled;                         // Профиль включён; без него замеры сводятся к одной проверке
+    const char *path;                    // Файл трассы
+    FILE *trace;
+    pthread_mutex_t lock;                // Фазы заканчиваются в разных потоках (интерфейс и симуляция)
+    phase_total total[PHASE_COUNT];
+    phase_total interval[PHASE_COUNT];
+    double start;                        // Начало профиля
+    double interval_start;               // Начало текущего интервала трассы
+    int counters;                        // Маска счётчиков, которые удалось открыть хоть в одном потоке
+    int failed;                          // Запись трассы не удалась
+} profiler;
+
+// Начало замера фазы: время и значения счётчиков потока
+typedef struct {
+    double seconds;
+    uint64_t counts[COUNTER_COUNT];
+} prof_mark;
+
+profiler prof = {.lock = PTHREAD_MUTEX_INITIALIZER};  // Профиль процесса (--profile)
+
+// Счётчики потока: открываются при первом замере в потоке и живут до его конца
+typedef struct {
+    int opened;              // Открытие уже пробовали
+    int fd[COUNTER_COUNT];   // Дескрипторы perf_event_open (-1 — счётчик недоступен)
+} prof_thread;
+
+static __thread prof_thread prof_local;
+
+double now_seconds(void);
+
+// Открываем счётчики вызывающего потока. Считаем только пользовательский режим: так счётчики
+// разрешены и при perf_event_paranoid = 2. Где их нет (виртуальная машина без PMU, другая ОС),
+// профиль остаётся с одним временем
+static void prof_open_thread(prof_thread *t) {
+#ifdef HAVE_PERF_EVENTS
+    static const uint64_t configs[COUNTER_COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+#endif
+    int opened = 0;  // Маска открытых счётчиков
+
+    t->opened = 1;
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        t->fd[c] = -1;
+#ifdef HAVE_PERF_EVENTS
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[c];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        t->fd[c] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);  // Этот поток, любой процессор
+        if (t->fd[c] >= 0) opened |= 1 << c;
+#endif
+    }
+    pthread_mutex_lock(&prof.lock);
+    prof.counters |= opened;
+    pthread_mutex_unlock(&prof.lock);
+}
+
+// Время и счётчики потока. Если событий больше, чем регистров PMU, ядро включает их по очереди —
+// значение масштабируется на долю времени, когда счётчик действительно считал
+static void prof_sample(prof_mark *m) {
+    if (!prof_local.opened) prof_open_thread(&prof_local);
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        uint64_t v[3];  // Значение, время включения и время счёта
+        m->counts[c] = 0;
+        if (prof_local.fd[c] >= 0 && read(prof_local.fd[c], v, sizeof(v)) == (ssize_t)sizeof(v) && v[2]) {
+            m->counts[c] = v[2] < v[1] ? (uint64_t)((double)v[0] * v[1] / v[2]) : v[0];
+        }
+    }
+    m->seconds = now_seconds();
+}
+
+// Пишем в трассу итоги фаз за интервал, закончившийся в момент now, и начинаем новый интервал.
+// Строка JSON на каждую фазу, выполнявшуюся в интервале (вызывается под prof.lock)
+static void prof_trace(double now) {
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        phase_total *t = &prof.interval[p];
+        if (!t->calls) continue;
+        fprintf(prof.trace, "{\"time\":%.3f,\"phase\":\"%s\",\"calls\":%llu,\"seconds\":%.6f",
+                now - prof.start, phase_names[p], (unsigned long long)t->calls, t->seconds);
+        for (int c = 0; c < COUNTER_COUNT; c++) {
+            if (prof.counters >> c & 1) {
+                fprintf(prof.trace, ",\"%s\":%llu", counter_names[c], (unsigned long long)t->counts[c]);
+            }
+        }
+        if (fputs("}\n", prof.trace) == EOF) prof.failed = 1;
+    }
+    memset(prof.interval, 0, sizeof(prof.interval));
+    prof.interval_start = now;
+}
+
+// Добавляем к итогам фазы и интервала события от m до end, а с timed — ещё вызов и его время
+// (вызывается под prof.lock)
+static void prof_add(const prof_mark *m, const prof_mark *end, int phase, int timed) {
+    phase_total *totals[2] = {&prof.total[phase], &prof.interval[phase]};
+
+    for (int i = 0; i < 2; i++) {
+        if (timed) {
+            totals[i]->calls++;
+            totals[i]->seconds += end->seconds - m->seconds;
+        }
+        for (int c = 0; c < COUNTER_COUNT; c++) totals[i]->counts[c] += end->counts[c] - m->counts[c];
+    }
+}
+
+// Конец замера фазы: добавляем её время и события к итогам и, если интервал истёк, пишем трассу
+static void prof_finish(const prof_mark *m, int phase) {
+    prof_mark end;
+
+    prof_sample(&end);
+    pthread_mutex_lock(&prof.lock);
+    prof_add(m, &end, phase, 1);
+    if (end.seconds - prof.interval_start >= PROFILE_INTERVAL) prof_trace(end.seconds);
+    pthread_mutex_unlock(&prof.lock);
+}
+
+// Конец доли фазы в потоке пула: добавляем только события. Вызов и время фазы считает поток, который
+// раздаёт работу, а доля пула заканчивается раньше его prof_end (до барьера конца поколения)
+static void prof_finish_share(const prof_mark *m, int phase) {
+    prof_mark end;
+
+    prof_sample(&end);
+    pthread_mutex_lock(&prof.lock);
+    prof_add(m, &end, phase, 0);
+    pthread_mutex_unlock(&prof.lock);
+}
+
+// Замер фазы: prof_begin в начале, prof_end в конце, prof_share — в потоках пула, работающих на фазу
+// чужого потока. Без --profile — только проверка флага
+static inline void prof_begin(prof_mark *m) {
+    if (prof.enabled) prof_sample(m);
+}
+
+static inline void prof_end(const prof_mark *m, int phase) {
+    if (prof.enabled) prof_finish(m, phase);
+}
+
+static inline void prof_share(const prof_mark *m, int phase) {
+    if (prof.enabled) prof_finish_share(m, phase);
+}
+
+// Закрываем счётчики потока перед его выходом
+static void prof_release(void) {
+    for (int c = 0; prof_local.opened && c < COUNTER_COUNT; c++) {
+        if (prof_local.fd[c] >= 0) close(prof_local.fd[c]);
+    }
+    prof_local.opened = 0;
+}
+
+// Включаем профиль с трассой в файл path
+int profile_open(const char *path) {
+    prof.trace = fopen(path, "w");
+    if (!prof.trace) {
+        fprintf(stderr, "Cannot open profile trace: %s\n", path);
+        return 0;
+    }
+    prof.path = path;
+    prof.start = prof.interval_start = now_seconds();
+    prof.enabled = 1;
+    return 1;
+}
+
+// Сводка профиля в stderr и последний интервал трассы. Доля — от всего времени работы: симуляция
+// и отрисовка интерактивного режима идут в разных потоках, и их доли вместе могут превысить 100%
+int profile_close(void) {
+    int success = 1;
+
+    if (prof.enabled) {
+        double now = now_seconds(), wall = now - prof.start;
+        prof.enabled = 0;
+        prof_trace(now);
+        if (fclose(prof.trace) != 0 || prof.failed) {
+            fprintf(stderr, "Error writing profile trace: %s\n", prof.path);
+            success = 0;
+        }
+        fprintf(stderr, "Profile: %.3f s%s\n%-6s %10s %12s %7s %15s %15s %6s %14s %14s\n", wall,
+                prof.counters ? "" : ", hardware counters unavailable", "phase", "calls", "seconds", "share",
+                "cycles", "instructions", "IPC", "cache_misses", "branch_misses");
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            const phase_total *t = &prof.total[p];
+            char counts[COUNTER_COUNT][24], ipc[16] = "-";
+            if (!t->calls) continue;
+            for (int c = 0; c < COUNTER_COUNT; c++) {
+                if (prof.counters >> c & 1) {
+                    snprintf(counts[c], sizeof(counts[c]), "%llu", (unsigned long long)t->counts[c]);
+                } else {
+                    strcpy(counts[c], "-");
+                }
+            }
+            if ((prof.counters & 3) == 3 && t->counts[COUNTER_CYCLES]) {
+                snprintf(ipc, sizeof(ipc), "%.2f",
+                         (double)t->counts[COUNTER_INSTRUCTIONS] / t->counts[COUNTER_CYCLES]);
+            }
+            fprintf(stderr, "%-6s %10llu %12.6f %6.1f%% %15s %15s %6s %14s %14s\n", phase_names[p],
+                    (unsigned long long)t->calls, t->seconds, wall > 0 ? 100 * t->seconds / wall : 0,
+                    counts[COUNTER_CYCLES], counts[COUNTER_INSTRUCTIONS], ipc, counts[COUNTER_CACHE_MISSES],
+                    counts[COUNTER_BRANCH_MISSES]);
+        }
+    }
+
+    return success;
+}
+
+// Создаём поле height x width: один выровненный по линии кэша буфер вместо malloc на каждую строку
+field *create_field(int height, int width) {
+    field *f = malloc(sizeof(field));  // Описание поля
+
+    if (f) {
+        f->height = height;
+        f->width = width;
+        f->stride = (width + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;  // Строки начинаются с линии кэша
+        f->cells = aligned_alloc(CACHE_LINE, (size_t)height * f->stride);
+        if (f->cells) {
+            memset(f->cells, 0, (size_t)height * f->stride);  // Все клетки мёртвые
+        } else {
+            free(f);  // Ошибка выделения памяти под клетки
+            f = NULL;
+        }
+    }
+
+    return f;  // Возвращаем указатель на поле или NULL при ошибке
+}
+
+// Освобождаем память поля
+void free_field(field *f) {
+    if (f) {
+        free(f->cells);  // Один буфер на все строки
+        free(f);
+    }
+}
+
+// Пробельный символ во входном файле (\r допускаем ради файлов с переводами строк Windows)
+int is_blank(int c) { return c == ' ' || c == '\n' || c == '\t' || c == '\r'; }
+
+// Заполняем таблицы правила по маскам birth и survive
+void rule_from_masks(rule *r, unsigned birth, unsigned survive) {
+    memset(r, 0, sizeof(rule));
+    r->birth = birth;
+    r->survive = survive;
+    for (int n = 0; n <= 8; n++) {
+        r->born[n] = (unsigned char)(birth >> n & 1);
+        r->keep[n] = (unsigned char)(survive >> n & 1);
+    }
+}
+
+// Разбор правила: "B36/S23" (буквы в любом регистре, части в любом порядке) или старая запись "23/36" (S/B).
+// Правило кончается на конце строки, пробельном символе или ','
+int parse_rule(const char *text, rule *r) {
+    unsigned masks[2] = {0, 0};  // Маски по порядку частей
+    char letters[2] = {0, 0};    // Буква части ('B', 'S' или 0 в записи S/B)
+    int part = 0, success = 1;
+    const char *start = text;    // Начало текущей части
+
+    for (const char *p = text; success && *p && !is_blank(*p) && *p != ','; p++) {
+        char c = *p >= 'a' && *p <= 'z' ? (char)(*p - 'a' + 'A') : *p;
+        if (c == '/' && part == 0) {
+            part = 1;
+            start = p + 1;
+        } else if ((c == 'B' || c == 'S') && p == start) {
+            letters[part] = c;  // Буква — только первым символом части
+        } else if (c >= '0' && c <= '8') {
+            masks[part] |= 1u << (c - '0');
+        } else {
+            success = 0;
+        }
+    }
+    if (success && part == 1 && letters[0] && letters[1] && letters[0] != letters[1]) {
+        int b = letters[0] == 'B' ? 0 : 1;  // Часть с рождением
+        rule_from_masks(r, masks[b], masks[1 - b]);
+    } else if (success && part == 1 && !letters[0] && !letters[1]) {
+        rule_from_masks(r, masks[1], masks[0]);  // Запись S/B
+    } else {
+        success = 0;
+    }
+
+    return success;
+}
+
+// Запись правила в виде "B36/S23"
+void format_rule(const rule *r, char *buf) {
+    char *p = buf;
+
+    *p++ = 'B';
+    for (int n = 0; n <= 8; n++) {
+        if (r->birth >> n & 1) *p++ = (char)('0' + n);
+    }
+    *p++ = '/';
+    *p++ = 'S';
+    for (int n = 0; n <= 8; n++) {
+        if (r->survive >> n & 1) *p++ = (char)('0' + n);
+    }
+    *p = '\0';
+}
+
+// Конец текущей строки: указатель на '\n' или на конец данных
+static const char *line_end(const char *p, const char *end) {
+    const char *eol = memchr(p, '\n', (size_t)(end - p));
+    return eol ? eol : end;
+}
+
+// Пропускаем строки-комментарии, начинающиеся с символа mark
+static const char *skip_comments(const char *p, const char *end, char mark) {
+    while (p < end && *p == mark) {
+        p = line_end(p, end);
+        if (p < end) p++;
+    }
+    return p;
+}
+
+// Размеры поля в формате 0/1: ширина — число значений в первой строке,
+// высота — число строк до хвоста из пустых строк
+static void measure_grid(board_file *b) {
+    const char *p = b->data, *end = b->data + b->size;
+
+    for (int i = 1; p < end; i++) {
+        const char *eol = line_end(p, end);
+        int tokens = 0;  // Число значений в строке
+        for (const char *c = p; c < eol; c++) {
+            if (!is_blank(*c) && (c == p || is_blank(c[-1]))) tokens++;  // Начало нового значения
+        }
+        if (tokens > 0) b->height = i;  // Запоминаем последнюю непустую строку
+        if (i == 1) b->width = tokens;
+        p = eol < end ? eol + 1 : end;
+    }
+}
+
+// Разбор заголовка RLE "x = m, y = n, rule = ...": размеры узора
+static int measure_rle(board_file *b) {
+    const char *end = b->data + b->size;
+    const char *p = skip_comments(b->data, end, '#');
+    const char *eol = line_end(p, end);
+    char header[256];  // Заголовок целиком (он короткий)
+    size_t len = (size_t)(eol - p) < sizeof(header) - 1 ? (size_t)(eol - p) : sizeof(header) - 1;
+    int success;
+
+    memcpy(header, p, len);
+    header[len] = '\0';
+    success = sscanf(header, " x = %d , y = %d", &b->width, &b->height) == 2;
+    if (!success) fprintf(stderr, "RLE: expected header 'x = <width>, y = <height>'\n");
+    const char *r = strstr(header, "rule");  // Необязательное "rule = B3/S23"
+    if (success && r) {
+        r += 4;
+        while (is_blank(*r) || *r == '=') r++;
+        b->has_rule = parse_rule(r, &b->rule);
+        if (!b->has_rule) {
+            fprintf(stderr, "RLE: unsupported rule '%s'\n", r);
+            success = 0;
+        }
+    }
+    b->body = eol < end ? eol + 1 : end;
+
+    return success;
+}
+
+// Размеры узора .cells: строки из '.' и 'O', комментарии начинаются с '!'
+static void measure_cells(board_file *b) {
+    const char *end = b->data + b->size;
+    const char *p = skip_comments(b->data, end, '!');
+
+    b->body = p;
+    for (int i = 1; p < end; i++) {
+        const char *eol = line_end(p, end), *last = eol;
+        while (last > p && is_blank(last[-1])) last--;  // Пробелы и \r в конце строки не считаем
+        if (last > p) b->height = i;
+        if (last - p > b->width) b->width = (int)(last - p);
+        p = eol < end ? eol + 1 : end;
+    }
+}
+
+void close_board(board_file *b);
+
+// Число из bytes байт в порядке little-endian
+static uint64_t get_le(const unsigned char *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+// Разбор заголовка контрольной точки: размеры, правило, номер поколения, кодирование и длина тела
+static int measure_checkpoint(board_file *b) {
+    const unsigned char *h = (const unsigned char *)b->data;
+    int success = b->size >= CKPT_HEADER;
+
+    if (!success) {
+        fprintf(stderr, "Checkpoint: truncated header\n");
+    } else {
+        unsigned birth = (unsigned)get_le(h + 16, 2), survive = (unsigned)get_le(h + 18, 2);
+        uint64_t height = get_le(h + 8, 4), width = get_le(h + 12, 4);
+        b->height = height <= MAX_SIDE ? (int)height : 0;  // Неверный размер отвергнет open_board
+        b->width = width <= MAX_SIDE ? (int)width : 0;
+        b->encoding = (int)get_le(h + 20, 4);
+        b->generation = get_le(h + 24, 8);
+        b->body_size = (size_t)get_le(h + 32, 8);
+        b->body = b->data + CKPT_HEADER;
+        if (b->body_size > b->size - CKPT_HEADER ||
+            (b->encoding != CKPT_RAW && b->encoding != CKPT_PACKBITS)) {
+            fprintf(stderr, "Checkpoint: corrupted header\n");
+            success = 0;
+        } else if (birth > 0x1FF || survive > 0x1FF) {
+            fprintf(stderr, "Checkpoint: unsupported rule (birth mask %#x, survive mask %#x)\n", birth,
+                    survive);
+            success = 0;
+        } else {
+            rule_from_masks(&b->rule, birth, survive);
+            b->has_rule = 1;
+        }
+    }
+
+    return success;
+}
+
+// Разбор заголовка доски движка disk: размеры, правило и поколение. Сами клетки остаются в файле —
+// доску продолжает только движок disk, открывая этот же файл на месте
+static int measure_disk(board_file *b) {
+    const unsigned char *h = (const unsigned char *)b->data;
+    int success = b->size >= DISK_HEADER;
+
+    if (!success) {
+        fprintf(stderr, "Board file: truncated header\n");
+    } else {
+        unsigned birth = (unsigned)get_le(h + 36, 2), survive = (unsigned)get_le(h + 38, 2);
+        uint64_t height = get_le(h + 8, 4), width = get_le(h + 12, 4);
+        b->height = height <= MAX_SIDE ? (int)height : 0;  // Неверный размер отвергнет open_board
+        b->width = width <= MAX_SIDE ? (int)width : 0;
+        b->generation = get_le(h + 24, 8);
+        if (birth > 0x1FF || survive > 0x1FF) {
+            fprintf(stderr, "Board file: unsupported rule (birth mask %#x, survive mask %#x)\n", birth,
+                    survive);
+            success = 0;
+        } else {
+            rule_from_masks(&b->rule, birth, survive);
+            b->has_rule = 1;
+        }
+    }
+
+    return success;
+}
+
+// Варинт LEB128: по 7 бит на байт, младшие первыми, старший бит байта — «дальше есть ещё».
+// Возвращает 0, если число обрезано или длиннее 64 бит
+static int get_varint(const unsigned char **p, const unsigned char *end, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        unsigned char c = *(*p)++;
+        *v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) return 1;
+    }
+    return 0;
+}
+
+// Кадр записи с позиции *p: тип и данные. Возвращает 0, если кадр обрезан (запись ещё пишется
+// или писатель упал) — всё до него остаётся годным
+static int stream_frame(const unsigned char **p, const unsigned char *end, int *type,
+                        const unsigned char **data, uint64_t *len) {
+    const unsigned char *q = *p;
+
+    if (q == end) return 0;
+    *type = *q++;
+    if (!get_varint(&q, end, len) || *len > (uint64_t)(end - q)) return 0;
+    *data = q;
+    *p = q + *len;
+    return 1;
+}
+
+// Разбор записи эволюции: заголовок и индекс в хвосте — первое и последнее поколения берутся из него,
+// кадры не читаются. Если хвоста нет (запись оборвана или читается из канала), проходим кадры
+// до последнего целого. Поколение по умолчанию — последнее
+static int measure_stream(board_file *b) {
+    const unsigned char *h = (const unsigned char *)b->data, *end = h + b->size, *p = h + STREAM_HEADER;
+    const size_t tail = 8 + sizeof(STREAM_END) - 1;  // Смещение индекса и сигнатура хвоста
+    uint64_t gen = 0, len, value;
+    int success = b->size >= STREAM_HEADER, seen = 0, type;  // seen — встретился ключевой кадр
+    const unsigned char *data;
+
+    if (success) {
+        unsigned birth = (unsigned)get_le(h + 16, 2), survive = (unsigned)get_le(h + 18, 2);
+        uint64_t height = get_le(h + 8, 4), width = get_le(h + 12, 4);
+        b->height = height <= MAX_SIDE ? (int)height : 0;  // Неверный размер отвергнет open_board
+        b->width = width <= MAX_SIDE ? (int)width : 0;
+        b->body = b->data + STREAM_HEADER;
+        success = birth <= 0x1FF && survive <= 0x1FF;
+        if (success) rule_from_masks(&b->rule, birth, survive);
+        b->has_rule = success;
+    }
+    if (success && b->size >= STREAM_HEADER + tail &&
+        memcmp(end - sizeof(STREAM_END) + 1, STREAM_END, sizeof(STREAM_END) - 1) == 0) {
+        uint64_t at = get_le(end - tail, 8);  // Запись закрыта: кадры кончаются индексом
+        const unsigned char *q = h + at;
+        success = at >= STREAM_HEADER && at < b->size - tail && *q == REC_INDEX &&
+                  stream_frame(&q, end - tail, &type, &data, &len);
+        if (success) {
+            b->index = data;
+            b->index_size = (size_t)len;
+            b->body_size = (size_t)(at - STREAM_HEADER);
+            end = h + at;
+        }
+    }
+    if (success && b->index) {  // Индекс: последнее поколение, число ключевых кадров и пары (поколение,
+                                // смещение) — первая пара даёт первое поколение записи
+        const unsigned char *q = b->index, *stop = q + b->index_size;
+        uint64_t count;
+        success = get_varint(&q, stop, &gen) && get_varint(&q, stop, &count) && count > 0 &&
+                  get_varint(&q, stop, &b->first_generation) && b->first_generation <= gen;
+        seen = success;
+    }
+    while (success && !b->index && stream_frame(&p, end, &type, &data, &len)) {  // Без индекса — по кадрам
+        const unsigned char *q = data;
+        if (type == REC_KEY && get_varint(&q, data + len, &value)) {
+            if (!seen) b->first_generation = value;
+            gen = value;
+            seen = 1;
+        } else if (type == REC_DELTA) {
+            gen++;
+        } else if (type == REC_SAME && get_varint(&q, data + len, &value)) {
+            gen += value;
+        } else {
+            success = 0;
+        }
+        if (success && !seen) success = 0;  // Запись начинается с ключевого кадра
+        if (success) b->body_size = (size_t)(p - h - STREAM_HEADER);
+    }
+    if (success && !seen) success = 0;
+    b->generation = gen;
+    if (!success) fprintf(stderr, "Recording: corrupted header or frames\n");
+
+    return success;
+}
+
+// Начинаем счёт с поколения gen записи (--seek) вместо последнего
+int stream_seek(board_file *b, uint64_t gen) {
+    int success = b->format == FORMAT_STREAM;
+
+    if (!success) {
+        fprintf(stderr, "--seek requires a recording made with --record\n");
+    } else if (gen < b->first_generation || gen > b->generation) {
+        fprintf(stderr, "Recording holds generations %llu..%llu, cannot seek to %llu\n",
+                (unsigned long long)b->first_generation, (unsigned long long)b->generation,
+                (unsigned long long)gen);
+        success = 0;
+    } else {
+        b->generation = gen;
+    }
+
+    return success;
+}
+
+// Отображаем файл в память и определяем его формат и размеры узора. Формат берётся из
+// расширения (.rle, .cells), иначе по первому символу: '#' или 'x' — RLE, '!' — .cells
+int open_board(const char *path, board_file *b) {
+    int success = 1;
+    prof_mark mark;
+    int fd;
+    struct stat st;
+
+    prof_begin(&mark);
+    fd = open(path, O_RDONLY);
+    memset(b, 0, sizeof(board_file));
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open file: %s\n", path);
+        success = 0;
+    } else if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        b->data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (b->data == MAP_FAILED) {
+            b->data = NULL;
+        } else {
+            b->size = (size_t)st.st_size;
+            b->mapped = 1;
+            madvise(b->data, b->size, MADV_SEQUENTIAL);  // Файл читается один раз подряд
+        }
+    }
+    if (success && !b->mapped) {  // Не обычный файл (канал) или mmap не удался — читаем целиком
+        size_t cap = 0;
+        ssize_t got = 1;
+        while (success && got > 0) {
+            if (b->size == cap) {
+                char *data = realloc(b->data, cap ? cap * 2 : 65536);
+                if (data) {
+                    b->data = data;
+                    cap = cap ? cap * 2 : 65536;
+                } else {
+                    success = 0;
+                }
+            }
+            if (success) got = read(fd, b->data + b->size, cap - b->size);
+            if (got > 0) b->size += (size_t)got;
+        }
+        if (!success) fprintf(stderr, "Memory allocation error\n");
+    }
+    if (fd >= 0) close(fd);
+
+    if (success) {
+        size_t len = strlen(path);
+        const char *p = b->data, *end = b->data + b->size;
+        while (p < end && is_blank(*p)) p++;
+        if (b->size >= sizeof(CKPT_MAGIC) - 1 && memcmp(b->data, CKPT_MAGIC, sizeof(CKPT_MAGIC) - 1) == 0) {
+            b->format = FORMAT_CHECKPOINT;  // Контрольная точка узнаётся по сигнатуре, а не по имени
+            success = measure_checkpoint(b);
+        } else if (b->size >= sizeof(STREAM_MAGIC) - 1 &&
+                   memcmp(b->data, STREAM_MAGIC, sizeof(STREAM_MAGIC) - 1) == 0) {
+            b->format = FORMAT_STREAM;  // Запись эволюции — тоже по сигнатуре
+            success = measure_stream(b);
+        } else if (b->size >= sizeof(DISK_MAGIC) - 1 &&
+                   memcmp(b->data, DISK_MAGIC, sizeof(DISK_MAGIC) - 1) == 0) {
+            b->format = FORMAT_DISK;  // Доска движка disk — тоже
+            success = measure_disk(b);
+        } else if ((len > 4 && strcmp(path + len - 4, ".rle") == 0) ||
+                   (p < end && (*p == '#' || *p == 'x'))) {
+            b->format = FORMAT_RLE;
+            success = measure_rle(b);
+        } else if ((len > 6 && strcmp(path + len - 6, ".cells") == 0) || (p < end && *p == '!')) {
+            b->format = FORMAT_CELLS;
+            measure_cells(b);
+        } else {
+            b->format = FORMAT_GRID;
+            b->body = b->data;
+            measure_grid(b);
+        }
+    }
+    if (success && (b->height <= 0 || b->width <= 0 || b->height > MAX_SIDE || b->width > MAX_SIDE)) {
+        fprintf(stderr, "Cannot determine board size from %s\n", path);
+        success = 0;
+    }
+    if (!success) close_board(b);
+    prof_end(&mark, PHASE_READ);
+
+    return success;
+}
+
+// Освобождаем отображение входного файла
+void close_board(board_file *b) {
+    if (b->data && b->mapped) munmap(b->data, b->size);
+    if (b->data && !b->mapped) free(b->data);
+    b->data = NULL;
+    b->size = 0;
+}
+
+// Разбор поля в формате 0/1 собственным сканером вместо sscanf на каждую клетку.
+// При exact == 0 файл может быть меньше поля (--size): недостающие клетки остаются мёртвыми.
+// Поле f — полоса строк [first, first + f->height) поля высотой height: строки выше полосы только
+// пропускаются (их проверяет тот, кто читает их полосу), хвост файла проверяется с последней полосой
+static int parse_grid(const board_file *b, field *f, int height, int first, int exact) {
+    int success = 1;  // Флаг успеха чтения
+    int eof = 0;      // Файл закончился раньше поля
+    const char *p = b->data, *end = b->data + b->size;
+
+    for (int i = 0; i < first + f->height && success && !eof; i++) {  // Разбираем строки поля
+        if (p >= end) {
+            if (exact) {
+                fprintf(stderr, "Error reading line %d\n", i);  // Строк меньше, чем нужно
+                success = 0;
+            }
+            eof = 1;
+        } else if (i < first) {
+            p = line_end(p, end);
+            if (p < end) p++;
+        } else {
+            const char *eol = line_end(p, end);
+            unsigned char *row = f->cells + (size_t)(i - first) * f->stride;
+
+            for (int j = 0; j < f->width; j++) {  // Читаем width чисел в строке
+                const char *start;
+                long val = 0;
+                int neg = 0;
+                while (p < eol && is_blank(*p)) p++;
+                start = p;
+                if (p < eol && (*p == '+' || *p == '-')) neg = *p++ == '-';
+                if (p == eol || *p < '0' || *p > '9') {  // Число не найдено
+                    if (exact) {
+                        fprintf(stderr, "Line %d: expected integer at position %d\n", i + 1, j + 1);
+                        success = 0;
+                    }
+                    p = start;
+                    break;
+                }
+                while (p < eol && *p >= '0' && *p <= '9') {
+                    if (val < 1000000000) val = val * 10 + (*p - '0');
+                    p++;
+                }
+                if (neg) val = -val;
+                if (val != 0 && val != 1) {  // Проверяем, что число либо 0, либо 1
+                    fprintf(stderr, "Line %d: invalid value %ld at position %d (only 0 or 1 allowed)\n",
+                            i + 1, val, j + 1);
+                    success = 0;
+                    break;
+                }
+                row[j] = (unsigned char)val;  // Записываем значение в поле
+            }
+
+            // Проверяем, нет ли лишних символов после width чисел
+            for (; success && p < eol; p++) {
+                if (!is_blank(*p)) {
+                    fprintf(stderr, "Line %d: extra characters after %d numbers\n", i + 1, f->width);
+                    success = 0;
+                }
+            }
+            p = eol < end ? eol + 1 : end;
+        }
+    }
+
+    // Проверяем, что после последней строки поля нет других символов кроме пробелов и переводов строки
+    for (; success && !eof && first + f->height == height && p < end; p++) {
+        if (!is_blank(*p)) {
+            fprintf(stderr, "Input has extra lines beyond %d rows\n", height);
+            success = 0;
+        }
+    }
+
+    return success;
+}
+
+// Разбор тела RLE: число — повтор, 'b' — мёртвые, 'o' и другие буквы — живые, '$' — конец строки,
+// '!' — конец узора. Узор кладётся в поле со сдвигом (top, left); в полосу f со строки first
+// попадают только её строки
+static int parse_rle(const board_file *b, field *f, int top, int left, int first) {
+    int success = 1, done = 0, y = 0, x = 0, line = 1;
+    long run = 0;  // Текущее число повторов (0 — не задано)
+
+    for (const char *p = b->data; p < b->body; p++) line += *p == '\n';  // Номер строки начала тела
+    for (const char *p = b->body, *end = b->data + b->size; p < end && success && !done; p++) {
+        char c = *p;
+        long n = run ? run : 1;
+        if (c >= '0' && c <= '9') {
+            if (run < MAX_SIDE) run = run * 10 + (c - '0');
+        } else if (c == '\n') {
+            line++;
+        } else if (is_blank(c)) {
+            continue;
+        } else if (c == '!') {
+            done = 1;
+        } else if (c == '$') {
+            y += (int)n;
+            x = 0;
+            run = 0;
+        } else if (c == 'b' || c == '.' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+            if (x + n > b->width || y >= b->height) {
+                fprintf(stderr, "Line %d: RLE pattern exceeds declared size %dx%d\n", line, b->width,
+                        b->height);
+                success = 0;
+            } else if (c != 'b' && c != '.' && top + y >= first && top + y < first + f->height) {
+                // Живые клетки (многоцветные буквы считаем живыми)
+                memset(f->cells + (size_t)(top + y - first) * f->stride + left + x, 1, (size_t)n);
+            }
+            x += (int)n;
+            run = 0;
+        } else {
+            fprintf(stderr, "Line %d: unexpected character '%c' in RLE pattern\n", line, c);
+            success = 0;
+        }
+    }
+
+    return success;
+}
+
+// Разбор узора .cells: '.' — мёртвая клетка, 'O' или '*' — живая. Полоса — как у parse_rle
+static int parse_cells(const board_file *b, field *f, int top, int left, int first) {
+    int success = 1, line = 1;
+    const char *p = b->body, *end = b->data + b->size;
+
+    for (const char *c = b->data; c < b->body; c++) line += *c == '\n';
+    for (int y = 0; p < end && success; y++, line++) {
+        const char *eol = line_end(p, end);
+        for (int x = 0; p + x < eol && success; x++) {
+            char c = p[x];
+            if (c == 'O' || c == '*') {
+                if (top + y >= first && top + y < first + f->height) CELL(f, top + y - first, left + x) = 1;
+            } else if (c != '.' && !is_blank(c)) {
+                fprintf(stderr, "Line %d: invalid character '%c' at position %d in .cells pattern\n", line, c,
+                        x + 1);
+                success = 0;
+            }
+        }
+        p = eol < end ? eol + 1 : end;
+    }
+
+    return success;
+}
+
+// Распаковка байта снимка с номером pos в восемь клеток полосы f со строки first
+static void put_packed(field *f, int first, size_t pos, size_t row_bytes, unsigned char byte) {
+    size_t i = pos / row_bytes - (size_t)first;  // Строки выше полосы дают огромное i
+    int j = (int)(pos % row_bytes) * 8;
+
+    if (i >= (size_t)f->height) return;
+    for (int k = 0; k < 8 && j + k < f->width; k++) CELL(f, i, j + k) = byte >> k & 1;
+}
+
+// Поле из упакованных строк, сжатых PackBits (управляющий байт c < 128 — далее c + 1 байт как есть,
+// c > 128 — следующий байт 257 - c раз). Возвращает 0, если данных не ровно на всё поле высотой height;
+// в полосу f со строки first попадают только её строки
+static int unpack_rows(const unsigned char *p, const unsigned char *end, field *f, int height, int first) {
+    size_t row_bytes = ((size_t)f->width + 7) / 8, total = row_bytes * height, pos = 0;
+    int success = 1;
+
+    while (success && p < end) {
+        unsigned c = *p++;
+        size_t n = c < 128 ? c + 1 : 257 - c;
+        if (c == 128) continue;  // Пустая команда
+        if (pos + n > total || (c < 128 ? (size_t)(end - p) < n : p == end)) {
+            success = 0;
+        } else if (c < 128) {
+            for (size_t k = 0; k < n; k++) put_packed(f, first, pos++, row_bytes, *p++);
+        } else {
+            for (size_t k = 0; k < n; k++) put_packed(f, first, pos++, row_bytes, *p);
+            p++;
+        }
+    }
+
+    return success && pos == total;
+}
+
+// Тело контрольной точки: упакованные строки, как есть или сжатые PackBits. Несжатое тело читается
+// только в пределах полосы f со строки first
+static int parse_checkpoint(const board_file *b, field *f, int first) {
+    const unsigned char *p = (const unsigned char *)b->body, *end = p + b->body_size;
+    size_t row_bytes = ((size_t)f->width + 7) / 8, total = row_bytes * b->height;
+    size_t pos = row_bytes * first, stop = row_bytes * (first + f->height);
+    int success = 1;
+
+    if (b->encoding == CKPT_RAW) {
+        success = b->body_size == total;
+        for (; success && pos < stop; pos++) put_packed(f, first, pos, row_bytes, p[pos]);
+    } else {
+        success = unpack_rows(p, end, f, b->height, first);
+    }
+    if (!success) fprintf(stderr, "Checkpoint: corrupted body\n");
+
+    return success;
+}
+
+// Поколение b->generation из записи: ближайший ключевой кадр не позже него (по индексу, а без индекса —
+// проходом по кадрам без разбора их данных), затем разностные кадры от него вперёд. В полосу f
+// со строки first попадают только её строки
+static int parse_stream(const board_file *b, field *f, int first) {
+    const unsigned char *p = (const unsigned char *)b->body, *end = p + b->body_size, *key = NULL, *data;
+    uint64_t target = b->generation, gen = 0, len, value;
+    int success = 1, type;
+
+    if (b->index) {  // Индекс: последнее поколение, число ключевых кадров и пары (поколение, смещение)
+        const unsigned char *q = b->index, *stop = q + b->index_size;
+        uint64_t count, offset;
+        success = get_varint(&q, stop, &value) && get_varint(&q, stop, &count);
+        for (uint64_t k = 0; success && k < count; k++) {
+            success = get_varint(&q, stop, &value) && get_varint(&q, stop, &offset) &&
+                      offset >= STREAM_HEADER && offset - STREAM_HEADER < b->body_size;
+            if (success && value <= target) key = (const unsigned char *)b->data + offset;
+        }
+    } else {
+        for (const unsigned char *q = p, *at = q; stream_frame(&q, end, &type, &data, &len); at = q) {
+            const unsigned char *v = data;
+            if (type == REC_KEY && get_varint(&v, data + len, &value)) {
+                if (value > target) break;
+                key = at;
+            }
+        }
+    }
+    success = success && key;
+    for (p = key; success && (gen < target || p == key) && stream_frame(&p, end, &type, &data, &len);) {
+        const unsigned char *q = data, *stop = data + len;
+        if (type == REC_KEY) {
+            success = get_varint(&q, stop, &gen) && gen <= target &&
+                      unpack_rows(q, stop, f, b->height, first);
+        } else if (type == REC_DELTA) {  // Серии изменившихся клеток, каждая меняет клетки на обратные
+            uint64_t cells = (uint64_t)b->height * f->width, pos = 0, gap, run;
+            uint64_t from = (uint64_t)first * f->width, to = from + (uint64_t)f->height * f->width;
+            while (success && q < stop) {
+                success = get_varint(&q, stop, &gap) && get_varint(&q, stop, &run) && gap <= cells - pos &&
+                          run < cells - pos - gap;
+                for (pos += success ? gap : 0; success && run-- != UINT64_MAX; pos++) {
+                    if (pos < from || pos >= to) continue;  // Клетка чужой полосы
+                    CELL(f, (pos - from) / f->width, pos % (uint64_t)f->width) ^= 1;
+                }
+            }
+            gen++;
+        } else if (type == REC_SAME && get_varint(&q, stop, &value)) {
+            gen = value < target - gen ? gen + value : target;  // Поле не меняется и после target
+        } else {
+            success = 0;
+        }
+    }
+    if (success && gen != target) success = 0;
+    if (!success) fprintf(stderr, "Recording: corrupted frames\n");
+
+    return success;
+}
+
+// Читаем строки [first, first + f->height) поля высотой height в полосу f. Формат 0/1 ложится в левый
+// верхний угол, компактные форматы — по центру поля, контрольная точка и запись эволюции
+// восстанавливаются только на поле своего размера
+int read_rows(const board_file *b, field *f, int height, int first, int exact) {
+    int success = 1;
+    prof_mark mark;
+
+    prof_begin(&mark);
+    if (b->format == FORMAT_GRID) {
+        success = parse_grid(b, f, height, first, exact);
+    } else if (b->format == FORMAT_CHECKPOINT || b->format == FORMAT_STREAM) {
+        if (b->height != height || b->width != f->width) {
+            fprintf(stderr, "%s is %dx%d, board is %dx%d\n",
+                    b->format == FORMAT_STREAM ? "Recording" : "Checkpoint", b->width, b->height, f->width,
+                    height);
+            success = 0;
+        } else {
+            success = b->format == FORMAT_STREAM ? parse_stream(b, f, first) : parse_checkpoint(b, f, first);
+        }
+    } else if (b->height > height || b->width > f->width) {
+        fprintf(stderr, "Pattern %dx%d does not fit into board %dx%d\n", b->width, b->height, f->width,
+                height);
+        success = 0;
+    } else {
+        int top = (height - b->height) / 2, left = (f->width - b->width) / 2;
+        success = b->format == FORMAT_RLE ? parse_rle(b, f, top, left, first)
+                                          : parse_cells(b, f, top, left, first);
+    }
+    prof_end(&mark, PHASE_READ);
+
+    return success;
+}
+
+// Читаем узор в поле целиком
+int read_board(const board_file *b, field *f, int exact) {
+    return read_rows(b, f, f->height, 0, exact);
+}
+
+// Размер поля для файла: --size, размеры файла 0/1 или узор компактного формата, но не меньше 80x25
+void board_size(const board_file *b, const options *opt, int *height, int *width) {
+    if (opt->height) {
+        *height = opt->height;
+        *width = opt->width;
+    } else if (b->format == FORMAT_GRID || b->format == FORMAT_CHECKPOINT || b->format == FORMAT_STREAM ||
+               b->format == FORMAT_DISK) {
+        *height = b->height;
+        *width = b->width;
+    } else {
+        *height = b->height > DEFAULT_HEIGHT ? b->height : DEFAULT_HEIGHT;
+        *width = b->width > DEFAULT_WIDTH ? b->width : DEFAULT_WIDTH;
+    }
+}
+
+// Записываем поле в формате 0/1, который читает read_board: строки из 0 и 1 через пробел
+int write_field(const field *f, FILE *out) {
+    int success = 1;
+    char *line = malloc((size_t)f->width * 2 + 1);  // Строка целиком, чтобы не писать по символу
+
+    if (!line) {
+        success = 0;
+    } else {
+        for (int i = 0; i < f->height && success; i++) {
+            for (int j = 0; j < f->width; j++) {
+                line[2 * j] = CELL(f, i, j) ? '1' : '0';
+                line[2 * j + 1] = j + 1 < f->width ? ' ' : '\n';
+            }
+            if (fwrite(line, 1, (size_t)f->width * 2, out) != (size_t)f->width * 2) success = 0;
+        }
+        free(line);
+    }
+
+    return success;
+}
+
+// То же для битового поля: строки распаковываются по одной, так что поле целиком в памяти не нужно
+int write_bits(const bitfield *b, FILE *out) {
+    int success = 1;
+    char *line = malloc((size_t)b->width * 2 + 1);
+
+    if (!line) {
+        success = 0;
+    } else {
+        for (int i = 0; i < b->height && success; i++) {
+            const uint64_t *row = b->bits + (size_t)i * b->words;
+            for (int j = 0; j < b->width; j++) {
+                line[2 * j] = (row[j / 64] >> (j % 64)) & 1 ? '1' : '0';
+                line[2 * j + 1] = j + 1 < b->width ? ' ' : '\n';
+            }
+            if (fwrite(line, 1, (size_t)b->width * 2, out) != (size_t)b->width * 2) success = 0;
+        }
+        free(line);
+    }
+
+    return success;
+}
+
+// Число v в bytes байт в порядке little-endian
+static void put_le(unsigned char *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = (unsigned char)(v >> 8 * i);
+}
+
+// Варинт LEB128 (см. get_varint); возвращает число записанных байт, не больше 10
+static size_t put_varint(unsigned char *p, uint64_t v) {
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+// Сжатие PackBits: серии от трёх одинаковых байт — парой (257 - длина, байт), остальное — блоками
+// до 128 байт с длиной - 1 впереди. Выход не длиннее n + n / 128 + 1
+size_t packbits(const unsigned char *in, size_t n, unsigned char *out) {
+    size_t i = 0, o = 0;
+
+    while (i < n) {
+        size_t run = 1;  // Длина серии одинаковых байт с позиции i
+        while (i + run < n && run < 128 && in[i + run] == in[i]) run++;
+        if (run >= 3) {
+            out[o++] = (unsigned char)(257 - run);
+            out[o++] = in[i];
+            i += run;
+        } else {
+            size_t lit = 1;  // Байты как есть — до начала следующей серии
+            while (i + lit < n && lit < 128 &&
+                   !(i + lit + 2 < n && in[i + lit] == in[i + lit + 1] && in[i + lit] == in[i + lit + 2])) {
+                lit++;
+            }
+            out[o++] = (unsigned char)(lit - 1);
+            memcpy(out + o, in + i, lit);
+            o += lit;
+            i += lit;
+        }
+    }
+
+    return o;
+}
+
+// Поток записи контрольной точки: сжимаем снимок и атомарно заменяем файл через rename
+void *checkpoint_writer(void *arg) {
+    checkpoint *ck = arg;
+    size_t path_len = strlen(ck->path);
+    char *tmp = malloc(path_len + 5);
+    unsigned char *body = malloc(ck->raw_size + ck->raw_size / 128 + 1);
+    unsigned char header[CKPT_HEADER] = {0};
+    FILE *out = NULL;
+    int success = tmp && body;
+
+    if (success) {
+        size_t size = packbits(ck->raw, ck->raw_size, body);
+        int packed = size < ck->raw_size;  // Несжимаемое поле (шум) храним как есть
+        memcpy(header, CKPT_MAGIC, sizeof(CKPT_MAGIC) - 1);
+        put_le(header + 8, (uint64_t)ck->height, 4);
+        put_le(header + 12, (uint64_t)ck->width, 4);
+        put_le(header + 16, life_rule.birth, 2);
+        put_le(header + 18, life_rule.survive, 2);
+        put_le(header + 20, packed ? CKPT_PACKBITS : CKPT_RAW, 4);
+        put_le(header + 24, ck->generation, 8);
+        put_le(header + 32, packed ? size : ck->raw_size, 8);
+
+        memcpy(tmp, ck->path, path_len);
+        memcpy(tmp + path_len, ".tmp", 5);
+        out = fopen(tmp, "wb");
+        success = out && fwrite(header, 1, CKPT_HEADER, out) == CKPT_HEADER &&
+                  fwrite(packed ? body : ck->raw, 1, packed ? size : ck->raw_size, out) ==
+                      (packed ? size : ck->raw_size);
+        if (out && fclose(out) != 0) success = 0;
+        if (success && rename(tmp, ck->path) != 0) success = 0;
+        if (!success && out) remove(tmp);
+    }
+    ck->failed = !success;
+    free(body);
+    free(tmp);
+
+    return NULL;
+}
+
+// Ждём завершения записи предыдущей контрольной точки. Возвращает 0, если она не удалась
+int checkpoint_wait(checkpoint *ck) {
+    if (ck->running) pthread_join(ck->thread, NULL);
+    ck->running = 0;
+    return !ck->failed;
+}
+
+// Снимаем поле поколения generation и отдаём его на запись фоновому потоку. Если предыдущая точка
+// ещё пишется, сначала дожидаемся её: в полёте не больше одного снимка
+int checkpoint_save(checkpoint *ck, const field *f, uint64_t generation) {
+    size_t row_bytes = ((size_t)f->width + 7) / 8;
+    int success = checkpoint_wait(ck);
+
+    if (success && (!ck->raw || ck->height != f->height || ck->width != f->width)) {
+        free(ck->raw);
+        ck->raw_size = row_bytes * f->height;
+        ck->raw = malloc(ck->raw_size);
+        ck->height = f->height;
+        ck->width = f->width;
+        if (!ck->raw) success = 0;
+        ck->failed = !success;
+    }
+    if (success) {
+        memset(ck->raw, 0, ck->raw_size);
+        for (int i = 0; i < f->height; i++) {  // Упаковываем по 8 клеток в байт
+            unsigned char *dst = ck->raw + (size_t)i * row_bytes;
+            for (int j = 0; j < f->width; j++) dst[j / 8] |= (unsigned char)(CELL(f, i, j) << (j % 8));
+        }
+        ck->generation = generation;
+        if (pthread_create(&ck->thread, NULL, checkpoint_writer, ck) == 0) {
+            ck->running = 1;
+        } else {
+            checkpoint_writer(ck);  // Поток не создался — пишем синхронно
+            success = !ck->failed;
+        }
+    }
+
+    return success;
+}
+
+// Освобождаем буфер снимка (запись должна быть завершена checkpoint_wait)
+void checkpoint_free(checkpoint *ck) {
+    free(ck->raw);
+    ck->raw = NULL;
+}
+
+// Пустая статистика перед накоплением по строкам
+void stats_reset(gen_stats *s) {
+    s->population = 0;
+    s->births = s->deaths = 0;
+    s->top = s->left = INT64_MAX;
+    s->bottom = s->right = INT64_MIN;
+}
+
+// Расширяем рамку живых клеток на отрезок [first, last] строки row
+static inline void stats_extent(gen_stats *s, int64_t row, int64_t first, int64_t last) {
+    if (row < s->top) s->top = row;
+    if (row > s->bottom) s->bottom = row;
+    if (first < s->left) s->left = first;
+    if (last > s->right) s->right = last;
+}
+
+// Добавляем к s статистику части поля (полосы потока или плитки)
+void stats_merge(gen_stats *s, const gen_stats *part) {
+    s->population += part->population;
+    s->births += part->births;
+    s->deaths += part->deaths;
+    if (part->population) {
+        stats_extent(s, part->top, part->left, part->right);
+        stats_extent(s, part->bottom, part->left, part->right);
+    }
+}
+
+// Учитываем строку row нового поколения now и ту же строку old предыдущего. Клетки — 0 или 1,
+// поэтому рождение — now > old, смерть — old > now, и цикл без ветвлений векторизуется
+VECTORIZE void stats_row_bytes(gen_stats *s, const unsigned char *old, const unsigned char *now, int n,
+                               int row) {
+    unsigned pop = 0, born = 0, died = 0;
+
+    for (int j = 0; j < n; j++) {
+        pop += now[j];
+        born += now[j] > old[j];
+        died += old[j] > now[j];
+    }
+    s->population += pop;
+    s->births += born;
+    s->deaths += died;
+    if (pop) {  // Края живых клеток в строке ищем, только если они есть
+        int first = 0, last = n - 1;
+        while (!now[first]) first++;
+        while (!now[last]) last--;
+        stats_extent(s, row, first, last);
+    }
+}
+
+// То же для строки битового поля из words слов
+void stats_row_bits(gen_stats *s, const uint64_t *old, const uint64_t *now, int words, int row) {
+    uint64_t pop = 0, born = 0, died = 0;
+    int first = -1, last = -1;  // Первое и последнее непустые слова
+
+    for (int k = 0; k < words; k++) {
+        pop += (uint64_t)__builtin_popcountll(now[k]);
+        born += (uint64_t)__builtin_popcountll(now[k] & ~old[k]);
+        died += (uint64_t)__builtin_popcountll(old[k] & ~now[k]);
+        if (now[k]) {
+            if (first < 0) first = k;
+            last = k;
+        }
+    }
+    s->population += pop;
+    s->births += (int64_t)born;
+    s->deaths += (int64_t)died;
+    if (first >= 0) {
+        stats_extent(s, row, (int64_t)first * 64 + __builtin_ctzll(now[first]),
+                     (int64_t)last * 64 + 63 - __builtin_clzll(now[last]));
+    }
+}
+
+// Статистика готового поля без предыдущего поколения — рождения и смерти неизвестны
+void stats_field(gen_stats *s, const field *f) {
+    stats_reset(s);
+    for (int i = 0; i < f->height; i++) {
+        const unsigned char *row = f->cells + (size_t)i * f->stride;
+        stats_row_bytes(s, row, row, f->width, i);
+    }
+    s->births = s->deaths = -1;
+}
+
+// Открываем поток статистики каждого every-го поколения в файл path: файл .json или .jsonl —
+// JSON Lines, любой другой — CSV с заголовком
+int stats_open(stats_stream *st, const char *path, uint64_t every) {
+    const char *dot = strrchr(path, '.');
+
+    st->path = path;
+    st->every = every;
+    st->json = dot && (strcmp(dot, ".json") == 0 || strcmp(dot, ".jsonl") == 0);
+    st->out = fopen(st->path, "w");
+    if (!st->out) {
+        fprintf(stderr, "Cannot open statistics file: %s\n", st->path);
+    } else if (!st->json) {
+        fprintf(st->out, "generation,population,births,deaths,top,left,bottom,right\n");
+    }
+
+    return st->out != NULL;
+}
+
+// Пишем статистику поколения gen. Неизвестные значения и рамка пустого поля — пустые поля CSV или null
+void stats_write(stats_stream *st, uint64_t gen, const gen_stats *s) {
+    const char *none = st->json ? "null" : "";  // Неизвестное значение
+    char births[24], deaths[24], box[112];       // Поля, которые могут отсутствовать
+
+    snprintf(births, sizeof(births), "%s", none);
+    snprintf(deaths, sizeof(deaths), "%s", none);
+    if (s->births >= 0) snprintf(births, sizeof(births), "%lld", (long long)s->births);
+    if (s->deaths >= 0) snprintf(deaths, sizeof(deaths), "%lld", (long long)s->deaths);
+    if (!s->population) {
+        snprintf(box, sizeof(box), "%s", st->json ? "null" : ",,,");
+    } else {
+        snprintf(box, sizeof(box), st->json ? "{\"top\":%lld,\"left\":%lld,\"bottom\":%lld,\"right\":%lld}"
+                                            : "%lld,%lld,%lld,%lld",
+                 (long long)s->top, (long long)s->left, (long long)s->bottom, (long long)s->right);
+    }
+    if (st->json) {
+        fprintf(st->out, "{\"generation\":%llu,\"population\":%llu,\"births\":%s,\"deaths\":%s,"
+                "\"bbox\":%s}\n",
+                (unsigned long long)gen, (unsigned long long)s->population, births, deaths, box);
+    } else {
+        fprintf(st->out, "%llu,%llu,%s,%s,%s\n", (unsigned long long)gen, (unsigned long long)s->population,
+                births, deaths, box);
+    }
+}
+
+// Закрываем поток статистики; ошибки записи всплывают здесь
+int stats_close(stats_stream *st) {
+    int success = !ferror(st->out);
+
+    if (fclose(st->out) != 0) success = 0;
+    st->out = NULL;
+    if (!success) fprintf(stderr, "Error writing statistics: %s\n", st->path);
+
+    return success;
+}
+
+// Подсчёт количества живых соседей у клетки с координатами (x, y)
+// На торе учтено замыкание поля по горизонтали и вертикали, за мёртвой границей соседей нет,
+// за отражающей сосед — ближайшая клетка края
+int neighbors(const field *f, int x, int y, int boundary) {
+    int count = 0;  // Кол-во живых соседей
+
+    for (int dx = -1; dx <= 1; dx++) {      // Проходим по смещению по вертикали
+        for (int dy = -1; dy <= 1; dy++) {  // Проходим по смещению по горизонтали
+            if (dx || dy) {  // Пропускаем центральную клетку (dx=0, dy=0)
+                int nx = x + dx, ny = y + dy;
+                if (boundary == BOUNDARY_TORUS) {
+                    nx = (nx + f->height) % f->height;  // Координата соседа по вертикали с учётом замыкания
+                    ny = (ny + f->width) % f->width;  // Координата соседа по горизонтали с учётом замыкания
+                } else if (boundary == BOUNDARY_REFLECT) {
+                    nx = nx < 0 ? 0 : nx >= f->height ? f->height - 1 : nx;
+                    ny = ny < 0 ? 0 : ny >= f->width ? f->width - 1 : ny;
+                } else if (nx < 0 || nx >= f->height || ny < 0 || ny >= f->width) {
+                    continue;  // За мёртвой границей
+                }
+                count += CELL(f, nx, ny);  // Прибавляем 1 если сосед жив
+            }
+        }
+    }
+
+    return count;  // Возвращаем число живых соседей
+}
+
+// Вычисление строк [from, to) следующего поколения клеток по правилам "Жизни".
+// Каждая клетка next перезаписывается, поэтому очищать буфер перед шагом не нужно
+void next_gen_rows(const field *curr, field *next, int from, int to, int boundary, gen_stats *st) {
+    for (int i = from; i < to; i++) {            // Для каждой строки полосы
+        for (int j = 0; j < curr->width; j++) {  // Для каждого столбца
+            int n = neighbors(curr, i, j, boundary);  // Считаем соседей у клетки (i,j)
+            int alive = CELL(curr, i, j);
+            // Живая клетка выживает, мёртвая оживает по таблицам правила (для B3/S23 — при 2-3 и 3 соседях)
+            CELL(next, i, j) = alive ? life_rule.keep[n] : life_rule.born[n];
+        }
+        // Статистика строки — пока обе строки ещё в кэше
+        if (st) stats_row_bytes(st, &CELL(curr, i, 0), &CELL(next, i, 0), curr->width, i);
+    }
+}
+
+// Вычисление следующего поколения всего поля
+void next_gen(const field *curr, field *next, int boundary) {
+    next_gen_rows(curr, next, 0, curr->height, boundary, NULL);
+}
+
+// Переносим поле f внутрь поля g с рамкой: клетка (i, j) ложится в (i + 1, j + 1)
+void halo_load(const field *f, field *g) {
+    for (int i = 0; i < f->height; i++) {
+        memcpy(g->cells + (size_t)(i + 1) * g->stride + 1, f->cells + (size_t)i * f->stride,
+               (size_t)f->width);
+    }
+}
+
+// Обратный перенос: внутренность поля с рамкой g в обычное поле f
+void halo_store(const field *g, field *f) {
+    for (int i = 0; i < f->height; i++) {
+        memcpy(f->cells + (size_t)i * f->stride, g->cells + (size_t)(i + 1) * g->stride + 1,
+               (size_t)f->width);
+    }
+}
+
+// Обновляем рамку призрачных клеток раз за поколение: на торе — с противоположных краёв, при отражении —
+// копией крайних клеток, у мёртвой границы — нулями. Сначала строки, потом столбцы, чтобы углы
+// получили значения с диагонально противоположного угла (тор) или угловой клетки (отражение)
+void halo_fill(field *g, int boundary) {
+    int h = g->height - 2, w = g->width - 2;
+    unsigned char *top = g->cells, *bottom = g->cells + (size_t)(h + 1) * g->stride;
+
+    if (boundary == BOUNDARY_DEAD) {
+        memset(top, 0, (size_t)g->width);
+        memset(bottom, 0, (size_t)g->width);
+    } else {
+        memcpy(top, g->cells + (size_t)(boundary == BOUNDARY_TORUS ? h : 1) * g->stride, (size_t)g->width);
+        memcpy(bottom, g->cells + (size_t)(boundary == BOUNDARY_TORUS ? 1 : h) * g->stride, (size_t)g->width);
+    }
+    for (int i = 0; i < h + 2; i++) {
+        unsigned char *row = g->cells + (size_t)i * g->stride;
+        if (boundary == BOUNDARY_DEAD) {
+            row[0] = row[w + 1] = 0;
+        } else {
+            row[0] = row[boundary == BOUNDARY_TORUS ? w : 1];
+            row[w + 1] = row[boundary == BOUNDARY_TORUS ? 1 : w];
+        }
+    }
+}
+
+// Совпадает ли число соседей n с одним из чисел маски. С константной маской выражение сворачивается
+// в несколько сравнений без ветвлений, которые компилятор векторизует (цикл по k он не разворачивает)
+#define RULE_BIT(mask, n, k) ((mask) >> (k) & 1u ? (n) == (k) : 0)
+#define RULE_MATCH(mask, n)                                                                                  \
+    (RULE_BIT(mask, n, 0) | RULE_BIT(mask, n, 1) | RULE_BIT(mask, n, 2) | RULE_BIT(mask, n, 3) |             \
+     RULE_BIT(mask, n, 4) | RULE_BIT(mask, n, 5) | RULE_BIT(mask, n, 6) | RULE_BIT(mask, n, 7) |             \
+     RULE_BIT(mask, n, 8))
+
+// Следующее состояние клетки с n соседями
+static ALWAYS_INLINE unsigned char rule_cell(unsigned char n, unsigned char alive, unsigned birth,
+                                             unsigned survive) {
+    return (unsigned char)((RULE_MATCH(birth, n) & (alive ^ 1)) | (RULE_MATCH(survive, n) & alive));
+}
+
+// Ядро строки с клетками в байтах для правила с константными масками: клетка j строки mid лежит
+// в mid[j + 1], соседи — рядом в памяти, поэтому цикл без делений и ветвлений векторизуется
+// (при -O2 GCC векторизует его только по явной просьбе VECTORIZE)
+#define RULE_ROW_KERNEL(name, birth, survive)                                                                \
+    VECTORIZE static void rule_row_##name(const unsigned char *up, const unsigned char *mid,                 \
+                                          const unsigned char *down, unsigned char *out, int n) {            \
+        for (int j = 0; j < n; j++) {                                                                        \
+            unsigned char s = up[j] + up[j + 1] + up[j + 2] + mid[j] + mid[j + 2] + down[j] + down[j + 1] + \
+                              down[j + 2];                                                                   \
+            out[j] = rule_cell(s, mid[j + 1], birth, survive);                                               \
+        }                                                                                                    \
+    }
+
+RULE_ROW_KERNEL(conway, LIFE_BIRTH, LIFE_SURVIVE)  // B3/S23
+RULE_ROW_KERNEL(highlife, 0x048u, 0x00Cu)          // B36/S23
+RULE_ROW_KERNEL(daynight, 0x1C8u, 0x1D8u)          // B3678/S34678
+RULE_ROW_KERNEL(seeds, 0x004u, 0x000u)             // B2/S
+
+// Ядро строки для любого другого правила. Маски копируются в локальные переменные: запись байта
+// в out могла бы изменить life_rule, и без копии компилятор перечитывал бы их на каждой клетке
+VECTORIZE static void rule_row_any(const unsigned char *up, const unsigned char *mid,
+                                   const unsigned char *down, unsigned char *out, int n) {
+    unsigned birth = life_rule.birth, survive = life_rule.survive;
+
+    for (int j = 0; j < n; j++) {
+        unsigned char s = up[j] + up[j + 1] + up[j + 2] + mid[j] + mid[j + 2] + down[j] + down[j + 1] +
+                          down[j + 2];
+        out[j] = rule_cell(s, mid[j + 1], birth, survive);
+    }
+}
+
+static life_row_fn rule_row = rule_row_conway;  // Ядро строки текущего правила (rule_init)
+
+// Строки [from, to) следующего поколения на поле с рамкой: строки поля с рамкой устроены так же,
+// как расширенные строки ядер, поэтому каждая строка считается ядром правила прямо на месте
+void next_gen_halo_rows(const field *curr, field *next, int from, int to, gen_stats *st) {
+    for (int i = from; i < to; i++) {
+        const unsigned char *up = curr->cells + (size_t)i * curr->stride;  // Строка i - 1 в координатах поля
+        const unsigned char *mid = up + curr->stride, *down = mid + curr->stride;
+        unsigned char *out = next->cells + (size_t)(i + 1) * next->stride + 1;
+        rule_row(up, mid, down, out, curr->width - 2);
+        if (st) stats_row_bytes(st, mid + 1, out, curr->width - 2, i);
+    }
+}
+
+// Создаём битовое поле height x width, все клетки мёртвые
+bitfield *create_bitfield(int height, int width) {
+    bitfield *b = malloc(sizeof(bitfield));  // Описание поля
+
+    if (b) {
+        b->height = height;
+        b->width = width;
+        b->words = (width + 63) / 64;  // Округляем ширину вверх до целых слов
+        b->tail = (width % 64) ? (((uint64_t)1 << (width % 64)) - 1) : ~(uint64_t)0;
+        b->bits = calloc((size_t)height * b->words, sizeof(uint64_t));  // Сразу обнулённая память
+        if (!b->bits) {  // Не хватило памяти под слова — освобождаем описание
+            free(b);
+            b = NULL;
+        }
+    }
+
+    return b;  // Указатель на поле или NULL при ошибке
+}
+
+// Освобождаем память битового поля
+void free_bitfield(bitfield *b) {
+    if (b) {
+        free(b->bits);
+        free(b);
+    }
+}
+
+// Упаковываем обычное поле в битовое: клетка (i, j) — бит j % 64 слова j / 64 строки i
+void pack_field(const field *f, bitfield *b) {
+    for (int i = 0; i < b->height; i++) {
+        uint64_t *row = b->bits + (size_t)i * b->words;  // Начало строки в битовом поле
+        for (int k = 0; k < b->words; k++) row[k] = 0;
+        for (int j = 0; j < b->width; j++) {
+            if (CELL(f, i, j)) row[j / 64] |= (uint64_t)1 << (j % 64);  // Ставим бит живой клетки
+        }
+    }
+}
+
+// Распаковываем битовое поле обратно в обычное (для отрисовки)
+void unpack_field(const bitfield *b, field *f) {
+    for (int i = 0; i < b->height; i++) {
+        const uint64_t *row = b->bits + (size_t)i * b->words;
+        for (int j = 0; j < b->width; j++) {
+            CELL(f, i, j) = (unsigned char)((row[j / 64] >> (j % 64)) & 1);
+        }
+    }
+}
+
+// Запись не удалась: сообщим при закрытии, а до тех пор симуляция идёт как шла
+static void record_fail(recorder *rec) {
+    pthread_mutex_lock(&rec->lock);
+    rec->failed = 1;
+    pthread_mutex_unlock(&rec->lock);
+}
+
+// Поток записи: пишет готовые блоки по порядку, пока запись не закрыта и очередь не пуста.
+// После ошибки блоки только освобождаются, чтобы поток симуляции не ждал места в очереди
+void *record_writer(void *arg) {
+    recorder *rec = arg;
+
+    pthread_mutex_lock(&rec->lock);
+    for (;;) {
+        while (!rec->count && !rec->closing) pthread_cond_wait(&rec->changed, &rec->lock);
+        if (!rec->count) break;
+        unsigned char *block = rec->queue[rec->head];
+        size_t size = rec->queue_size[rec->head];
+        int failed = rec->failed;
+        pthread_mutex_unlock(&rec->lock);
+        // Каналу блок отдаём сразу, чтобы читатель на том конце не ждал следующего
+        if (!failed && (fwrite(block, 1, size, rec->out) != size || fflush(rec->out) != 0)) failed = 1;
+        free(block);
+        pthread_mutex_lock(&rec->lock);
+        rec->failed |= failed;
+        rec->head = (rec->head + 1) % RECORD_QUEUE;
+        rec->count--;
+        pthread_cond_broadcast(&rec->changed);
+    }
+    pthread_mutex_unlock(&rec->lock);
+
+    return NULL;
+}
+
+// Отдаём заполненный блок потоку записи. Ждём только при полной очереди — диск или канал не успевают
+static void record_submit(recorder *rec) {
+    if (rec->used) {
+        pthread_mutex_lock(&rec->lock);
+        while (rec->count == RECORD_QUEUE) pthread_cond_wait(&rec->changed, &rec->lock);
+        rec->queue[(rec->head + rec->count) % RECORD_QUEUE] = rec->block;
+        rec->queue_size[(rec->head + rec->count) % RECORD_QUEUE] = rec->used;
+        rec->count++;
+        pthread_cond_broadcast(&rec->changed);
+        pthread_mutex_unlock(&rec->lock);
+        rec->block = NULL;
+        rec->used = rec->size = 0;
+    }
+}
+
+// Место под n байт в заполняемом блоке; не влезает — блок уходит на запись и начинается новый
+// (кадр крупнее RECORD_BLOCK получает блок своего размера)
+static unsigned char *record_reserve(recorder *rec, size_t n) {
+    if (rec->used + n > rec->size) {
+        record_submit(rec);
+        rec->size = n > RECORD_BLOCK ? n : RECORD_BLOCK;
+        rec->block = malloc(rec->size);
+        if (!rec->block) {
+            rec->size = 0;
+            record_fail(rec);
+        }
+    }
+    return rec->block ? rec->block + rec->used : NULL;
+}
+
+// Дописываем кадр: тип, длина данных варинтом и данные
+static void record_emit(recorder *rec, int type, const unsigned char *data, size_t len) {
+    unsigned char *p = record_reserve(rec, 1 + 10 + len);
+
+    if (p) {
+        size_t n = 0;
+        p[n++] = (unsigned char)type;
+        n += put_varint(p + n, len);
+        memcpy(p + n, data, len);
+        rec->used += n + len;
+        rec->offset += n + len;
+    }
+}
+
+// Буфер кадра, в котором после used байт есть ещё need
+static int record_room(recorder *rec, size_t used, size_t need) {
+    if (used + need > rec->frame_size) {
+        size_t size = rec->frame_size * 2 > used + need ? rec->frame_size * 2 : used + need;
+        unsigned char *frame = realloc(rec->frame, size);
+        if (!frame) {
+            record_fail(rec);
+            return 0;
+        }
+        rec->frame = frame;
+        rec->frame_size = size;
+    }
+    return 1;
+}
+
+// Накопленные поколения без изменений — одним кадром повтора
+static void record_flush_same(recorder *rec) {
+    if (rec->same) {
+        unsigned char data[10];
+        record_emit(rec, REC_SAME, data, put_varint(data, rec->same));
+        rec->same = 0;
+    }
+}
+
+// Ключевой кадр: поле целиком, его поколение и смещение запоминаются для индекса в хвосте
+static void record_keyframe(recorder *rec, const bitfield *b, uint64_t gen) {
+    size_t row_bytes = ((size_t)b->width + 7) / 8, raw_size = row_bytes * b->height, n;
+
+    if (rec->nkeys == rec->keys_cap) {
+        size_t cap = rec->keys_cap ? rec->keys_cap * 2 : 64;
+        uint64_t *keys = realloc(rec->keys, cap * 2 * sizeof(uint64_t));
+        if (!keys) {
+            record_fail(rec);
+            return;
+        }
+        rec->keys = keys;
+        rec->keys_cap = cap;
+    }
+    if (record_room(rec, 0, 10 + raw_size + raw_size / 128 + 1)) {
+        for (int i = 0; i < b->height; i++) {  // Слово строки — 8 байт снимка, младший байт первым
+            const uint64_t *row = b->bits + (size_t)i * b->words;
+            unsigned char *dst = rec->raw + (size_t)i * row_bytes;
+            for (size_t c = 0; c < row_bytes; c++) dst[c] = (unsigned char)(row[c / 8] >> (c % 8 * 8));
+        }
+        n = put_varint(rec->frame, gen);
+        n += packbits(rec->raw, raw_size, rec->frame + n);
+        rec->keys[2 * rec->nkeys] = gen;
+        rec->keys[2 * rec->nkeys + 1] = rec->offset;
+        rec->nkeys++;
+        record_emit(rec, REC_KEY, rec->frame, n);
+        memcpy(rec->prev->bits, b->bits, (size_t)b->height * b->words * sizeof(uint64_t));
+    }
+}
+
+// Серия изменившихся клеток [start, start + len) в кадр: отступ от конца предыдущей серии и длина - 1
+static int record_run(recorder *rec, size_t *n, uint64_t *end, uint64_t start, uint64_t len) {
+    if (!record_room(rec, *n, 20)) return 0;
+    *n += put_varint(rec->frame + *n, start - *end);
+    *n += put_varint(rec->frame + *n, len - 1);
+    *end = start + len;
+    return 1;
+}
+
+// Записываем поколение gen. Первое, кратные keyframe_every и идущие после пропуска — ключевым кадром,
+// остальные — XOR с предыдущим поколением по словам: неизменные слова пропускаются целиком,
+// серии изменившихся битов внутри слова находятся через ctz
+void record_frame(recorder *rec, const bitfield *b, uint64_t gen) {
+    if (!rec->nkeys || gen != rec->generation + 1 || gen % rec->keyframe_every == 0) {
+        record_flush_same(rec);
+        record_keyframe(rec, b, gen);
+    } else {
+        size_t n = 0;
+        uint64_t start = 0, len = 0, end = 0;  // Текущая серия и конец последней записанной
+        int success = 1;
+        for (int i = 0; i < b->height && success; i++) {
+            const uint64_t *now = b->bits + (size_t)i * b->words;
+            uint64_t *old = rec->prev->bits + (size_t)i * b->words;
+            for (int k = 0; k < b->words && success; k++) {
+                uint64_t diff = now[k] ^ old[k];  // Биты за шириной поля в обоих словах нулевые
+                old[k] = now[k];
+                while (diff && success) {
+                    int bit = __builtin_ctzll(diff);
+                    uint64_t ones = ~(diff >> bit);  // Серия единиц от bit — до первого нуля
+                    int run = ones ? __builtin_ctzll(ones) : 64 - bit;
+                    uint64_t pos = (uint64_t)i * b->width + (uint64_t)k * 64 + bit;
+                    diff = bit + run < 64 ? diff & ~(uint64_t)0 << (bit + run) : 0;
+                    if (len && start + len == pos) {  // Продолжение серии из прошлого слова или строки
+                        len += run;
+                    } else {
+                        if (len) success = record_run(rec, &n, &end, start, len);
+                        start = pos;
+                        len = run;
+                    }
+                }
+            }
+        }
+        if (success && len) success = record_run(rec, &n, &end, start, len);
+        if (success && n) {
+            record_flush_same(rec);
+            record_emit(rec, REC_DELTA, rec->frame, n);
+        } else if (success) {
+            rec->same++;  // Поле не изменилось
+        }
+    }
+    rec->generation = gen;
+}
+
+// Поле не меняется ещё count поколений (натюрморт): без сравнения, одним кадром повтора
+void record_same(recorder *rec, uint64_t count) {
+    rec->same += count;
+    rec->generation += count;
+}
+
+// Освобождаем буферы записи (поток записи уже остановлен)
+static void record_free(recorder *rec) {
+    free(rec->block);
+    free(rec->frame);
+    free(rec->raw);
+    free(rec->keys);
+    free_bitfield(rec->prev);
+    free_bitfield(rec->pack);
+    rec->block = rec->frame = rec->raw = NULL;
+    rec->keys = NULL;
+    rec->prev = rec->pack = NULL;
+}
+
+// Открываем запись поля height x width: пишем заголовок и запускаем поток записи.
+// Первым кадром record_frame запишет начальное поколение
+int record_open(recorder *rec, const char *path, int height, int width, uint64_t keyframe_every) {
+    unsigned char *p;
+    int success;
+
+    rec->path = path;
+    rec->keyframe_every = keyframe_every;
+    rec->out = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    rec->raw = malloc(((size_t)width + 7) / 8 * height);
+    rec->prev = create_bitfield(height, width);
+    rec->pack = create_bitfield(height, width);
+    success = rec->out && rec->raw && rec->prev && rec->pack;
+    if (!rec->out) {
+        fprintf(stderr, "Cannot open recording file: %s\n", path);
+    } else if (!success) {
+        fprintf(stderr, "Memory allocation error\n");
+    }
+    if (success) {
+        pthread_mutex_init(&rec->lock, NULL);
+        pthread_cond_init(&rec->changed, NULL);
+        success = pthread_create(&rec->thread, NULL, record_writer, rec) == 0;
+        if (!success) {
+            fprintf(stderr, "Cannot start recording thread\n");
+            pthread_cond_destroy(&rec->changed);
+            pthread_mutex_destroy(&rec->lock);
+        }
+    }
+    if (success && (p = record_reserve(rec, STREAM_HEADER))) {
+        memset(p, 0, STREAM_HEADER);
+        memcpy(p, STREAM_MAGIC, sizeof(STREAM_MAGIC) - 1);
+        put_le(p + 8, (uint64_t)height, 4);
+        put_le(p + 12, (uint64_t)width, 4);
+        put_le(p + 16, life_rule.birth, 2);
+        put_le(p + 18, life_rule.survive, 2);
+        put_le(p + 20, keyframe_every < UINT32_MAX ? keyframe_every : UINT32_MAX, 4);
+        rec->used += STREAM_HEADER;
+        rec->offset += STREAM_HEADER;
+    }
+    if (!success) {
+        if (rec->out && rec->out != stdout) fclose(rec->out);
+        rec->out = NULL;
+        record_free(rec);
+    }
+
+    return success;
+}
+
+// Закрываем запись: индекс ключевых кадров в хвосте, дожидаемся потока записи. Ошибки всплывают здесь
+int record_close(recorder *rec) {
+    unsigned char *p;
+    int success;
+
+    record_flush_same(rec);
+    if (record_room(rec, 0, 20 + rec->nkeys * 20)) {
+        uint64_t at = rec->offset;  // Смещение кадра индекса
+        size_t n = put_varint(rec->frame, rec->generation);
+        n += put_varint(rec->frame + n, rec->nkeys);
+        for (size_t k = 0; k < 2 * rec->nkeys; k++) n += put_varint(rec->frame + n, rec->keys[k]);
+        record_emit(rec, REC_INDEX, rec->frame, n);
+        if ((p = record_reserve(rec, 8 + sizeof(STREAM_END) - 1))) {
+            put_le(p, at, 8);
+            memcpy(p + 8, STREAM_END, sizeof(STREAM_END) - 1);
+            rec->used += 8 + sizeof(STREAM_END) - 1;
+        }
+    }
+    record_submit(rec);
+    pthread_mutex_lock(&rec->lock);
+    rec->closing = 1;
+    pthread_cond_broadcast(&rec->changed);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->thread, NULL);
+    pthread_cond_destroy(&rec->changed);
+    pthread_mutex_destroy(&rec->lock);
+
+    success = !rec->failed;
+    if (rec->out != stdout ? fclose(rec->out) != 0 : fflush(rec->out) != 0) success = 0;
+    rec->out = NULL;
+    if (!success) fprintf(stderr, "Error writing recording: %s\n", rec->path);
+    record_free(rec);
+
+    return success;
+}
+
+// Число процессоров в системе, но не больше limit — потоков по умолчанию для пулов экспорта и поиска
+static int online_cpus(int limit) {
+    long long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n < 1 ? 1 : n > limit ? limit : (int)n;
+}
+
+// Таблица CRC-32 чанков PNG (многочлен 0xEDB88320), строится при открытии экспорта
+static uint32_t crc_table[256];
+
+static void crc_init(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+static uint32_t crc32_of(const unsigned char *p, size_t n) {
+    uint32_t c = 0xFFFFFFFFu;
+
+    while (n--) c = crc_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+static void put_be32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+// Цвета кадров: индекс 0 — мёртвая клетка, 1 — живая (палитры PNG и GIF, пиксели PPM)
+static const unsigned char export_palette[2][3] = {{0x00, 0x00, 0x00}, {0xFF, 0xFF, 0xFF}};
+
+// Строка y изображения: по байту 0/1 на пиксель. При увеличении клетка — квадрат scale x scale пикселей,
+// при уменьшении пиксель жив, если жива хоть одна клетка его квадрата shrink x shrink. Пустые слова
+// пропускаются, так что разреженное поле рисуется быстро
+static void export_line(const exporter *x, const bitfield *b, int y, unsigned char *px) {
+    int first = x->shrink > 1 ? y * x->shrink : y / x->scale;             // Строки поля этого пикселя
+    int last = x->shrink > 1 ? first + x->shrink : first + 1;
+
+    memset(px, 0, (size_t)x->image_width);
+    if (last > b->height) last = b->height;
+    for (int i = first; i < last; i++) {
+        const uint64_t *row = b->bits + (size_t)i * b->words;
+        for (int k = 0; k < b->words; k++) {
+            for (uint64_t w = row[k] & (k == b->words - 1 ? b->tail : ~(uint64_t)0); w; w &= w - 1) {
+                int j = k * 64 + __builtin_ctzll(w);
+                if (x->shrink > 1) {
+                    px[j / x->shrink] = 1;
+                } else {
+                    memset(px + (size_t)j * x->scale, 1, (size_t)x->scale);
+                }
+            }
+        }
+    }
+}
+
+// Буфер кадра не меньше need байт (буферы кадров переиспользуются и только растут)
+static int export_reserve(export_slot *s, size_t need) {
+    if (need > s->cap) {
+        unsigned char *data = realloc(s->data, need);
+        if (!data) return 0;
+        s->data = data;
+        s->cap = need;
+    }
+    return 1;
+}
+
+// Кадр PPM (P6): три байта цвета на пиксель. Повторные строки увеличенной клетки копируются
+static int export_ppm(const exporter *x, export_slot *s, unsigned char *px) {
+    char head[64];
+    int n = snprintf(head, sizeof(head), "P6\n%d %d\n255\n", x->image_width, x->image_height);
+    size_t line = (size_t)x->image_width * 3;
+    unsigned char *p;
+
+    if (!export_reserve(s, (size_t)n + line * x->image_height)) return 0;
+    memcpy(s->data, head, (size_t)n);
+    p = s->data + n;
+    for (int y = 0; y < x->image_height; y++, p += line) {
+        if (x->scale > 1 && y % x->scale) {
+            memcpy(p, p - line, line);
+        } else {
+            export_line(x, s->cells, y, px);
+            for (int j = 0; j < x->image_width; j++) memcpy(p + (size_t)j * 3, export_palette[px[j]], 3);
+        }
+    }
+    s->size = (size_t)(p - s->data);
+    return 1;
+}
+
+// Поток несжатых блоков deflate внутри zlib: заголовок блока перед каждыми EXPORT_STORED байтами
+typedef struct {
+    unsigned char *p;  // Куда писать
+    size_t left;       // Байт до конца текущего блока
+    size_t rest;       // Байт до конца потока
+    uint32_t a, b;     // Суммы Adler-32
+} png_stream;
+
+static void png_put(png_stream *z, const unsigned char *data, size_t n) {
+    while (n) {
+        if (!z->left) {
+            z->left = z->rest < EXPORT_STORED ? z->rest : EXPORT_STORED;
+            *z->p++ = z->left == z->rest;  // BFINAL у последнего блока, тип 00 — без сжатия
+            put_le(z->p, z->left, 2);
+            put_le(z->p + 2, ~z->left & 0xFFFF, 2);
+            z->p += 4;
+        }
+        size_t part = n < z->left ? n : z->left;
+        if (part > 5552) part = 5552;  // Суммы Adler-32 не переполняются до взятия остатка
+        for (size_t i = 0; i < part; i++) {
+            z->a += data[i];
+            z->b += z->a;
+        }
+        z->a %= 65521;
+        z->b %= 65521;
+        memcpy(z->p, data, part);
+        z->p += part;
+        z->left -= part;
+        z->rest -= part;
+        data += part;
+        n -= part;
+    }
+}
+
+// Чанк PNG: длина, тип, данные (уже лежат на месте после p + 8) и CRC. Возвращает конец чанка
+static unsigned char *png_chunk(unsigned char *p, const char *type, size_t len) {
+    put_be32(p, (uint32_t)len);
+    memcpy(p + 4, type, 4);
+    put_be32(p + 8 + len, crc32_of(p + 4, len + 4));
+    return p + 12 + len;
+}
+
+// Кадр PNG: палитра из двух цветов, бит на пиксель (старший бит байта — левый пиксель). Данные идут
+// несжатыми блоками deflate: бит на пиксель уже в 24 раза меньше PPM, а кодер остаётся дешевле шага.
+// Строка — байт фильтра 0 и пиксели; повторные строки увеличенной клетки берутся готовыми
+static int export_png(const exporter *x, export_slot *s, unsigned char *px, unsigned char *line) {
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    size_t width = 1 + ((size_t)x->image_width + 7) / 8, raw = width * x->image_height;
+    size_t zlen = 2 + raw + 5 * (raw / EXPORT_STORED + 1) + 4;  // Не меньше настоящей длины
+    png_stream z = {.rest = raw, .a = 1};
+    unsigned char *p, *idat;
+
+    if (!export_reserve(s, 8 + 25 + 18 + 12 + zlen + 12)) return 0;
+    p = s->data;
+    memcpy(p, signature, 8);
+    p += 8;
+    put_be32(p + 8, (uint32_t)x->image_width);
+    put_be32(p + 12, (uint32_t)x->image_height);
+    memcpy(p + 16, "\x01\x03\x00\x00\x00", 5);  // Бит на пиксель, палитра, без чересстрочности
+    p = png_chunk(p, "IHDR", 13);
+    memcpy(p + 8, export_palette, 6);
+    p = png_chunk(p, "PLTE", 6);
+    idat = p;
+    z.p = p + 8;
+    *z.p++ = 0x78;  // Заголовок zlib: deflate с окном 32 КБ, без словаря
+    *z.p++ = 0x01;
+    for (int y = 0; y < x->image_height; y++) {
+        if (!(x->scale > 1 && y % x->scale)) {
+            export_line(x, s->cells, y, px);
+            memset(line, 0, width);
+            for (int j = 0; j < x->image_width; j++) line[1 + j / 8] |= (unsigned char)(px[j] << (7 - j % 8));
+        }
+        png_put(&z, line, width);
+    }
+    put_be32(z.p, z.b << 16 | z.a);
+    z.p += 4;
+    p = png_chunk(idat, "IDAT", (size_t)(z.p - idat - 8));
+    p = png_chunk(p, "IEND", 0);
+    s->size = (size_t)(p - s->data);
+    return 1;
+}
+
+// Коды LZW кадра GIF: младшими битами вперёд, байты — подблоками до 255 байт
+typedef struct {
+    unsigned char *p;      // Куда писать
+    unsigned char *block;  // Байт длины текущего подблока (NULL — подблок не начат)
+    uint32_t acc;          // Ещё не записанные биты
+    int nbits;             // Их число
+} gif_bits;
+
+static void gif_byte(gif_bits *g, unsigned char byte) {
+    if (!g->block || *g->block == 255) {
+        g->block = g->p++;
+        *g->block = 0;
+    }
+    *g->p++ = byte;
+    (*g->block)++;
+}
+
+static void gif_code(gif_bits *g, int code, int size) {
+    g->acc |= (uint32_t)code << g->nbits;
+    for (g->nbits += size; g->nbits >= 8; g->nbits -= 8) {
+        gif_byte(g, (unsigned char)g->acc);
+        g->acc >>= 8;
+    }
+}
+
+// Кадр GIF: расширение с паузой, описание изображения и пиксели, сжатые LZW. В словаре всего два
+// символа, поэтому он — массив детей trie[код * 2 + пиксель] на 4096 кодов. Коды 4 и 5 — очистка
+// и конец; ширина кода растёт, когда следующий свободный код перестаёт в неё помещаться, а на 4096
+// словарь очищается
+static int export_gif(const exporter *x, export_slot *s, unsigned char *px, uint16_t *trie) {
+    size_t pixels = (size_t)x->image_width * x->image_height;
+    gif_bits g = {0};
+    int key = -1, size = 3, next = 6;
+    unsigned char *p;
+
+    if (!export_reserve(s, 19 + pixels * 2 + 1024)) return 0;  // Код на пиксель — не больше 12 бит
+    p = s->data;
+    memcpy(p, "\x21\xF9\x04\x00", 4);  // Управление кадром: без прозрачности
+    put_le(p + 4, EXPORT_GIF_DELAY, 2);
+    memcpy(p + 6, "\x00\x00\x2C\x00\x00\x00\x00", 7);  // Конец расширения, кадр с угла (0, 0)
+    put_le(p + 13, (uint64_t)x->image_width, 2);
+    put_le(p + 15, (uint64_t)x->image_height, 2);
+    p[17] = 0;  // Без своей палитры и чересстрочности
+    p[18] = 2;  // Наименьшая ширина кода LZW
+    g.p = p + 19;
+    memset(trie, 0, 4096 * 2 * sizeof(uint16_t));
+    gif_code(&g, 4, size);
+    for (int y = 0; y < x->image_height; y++) {
+        if (!(x->scale > 1 && y % x->scale)) export_line(x, s->cells, y, px);
+        for (int j = 0; j < x->image_width; j++) {
+            int c = px[j];
+            if (key < 0) {
+                key = c;
+            } else if (trie[key * 2 + c]) {
+                key = trie[key * 2 + c];
+            } else {
+                gif_code(&g, key, size);
+                if (next < 4096) {
+                    if (next == 1 << size) size++;
+                    trie[key * 2 + c] = (uint16_t)next++;
+                } else {
+                    gif_code(&g, 4, size);
+                    memset(trie, 0, 4096 * 2 * sizeof(uint16_t));
+                    size = 3;
+                    next = 6;
+                }
+                key = c;
+            }
+        }
+    }
+    gif_code(&g, key, size);
+    gif_code(&g, 5, size);
+    if (g.nbits) gif_byte(&g, (unsigned char)g.acc);
+    *g.p++ = 0;  // Конец подблоков кадра
+    s->size = (size_t)(g.p - s->data);
+    return 1;
+}
+
+// Поток кодирования: берёт кадры очереди по порядку и кодирует их в свои буферы. Кадр с ошибкой
+// всё равно отмечается готовым, чтобы поток записи не ждал его вечно
+void *export_worker(void *arg) {
+    exporter *x = arg;
+    unsigned char *px = malloc((size_t)x->image_width);                // Пиксели строки
+    unsigned char *line = malloc(((size_t)x->image_width + 7) / 8 + 1);  // Строка PNG
+    uint16_t *trie = malloc(4096 * 2 * sizeof(uint16_t));                // Словарь LZW
+
+    pthread_mutex_lock(&x->lock);
+    for (;;) {
+        while (x->taken == x->submitted && !x->closing) pthread_cond_wait(&x->changed, &x->lock);
+        if (x->taken == x->submitted) break;
+        export_slot *s = &x->slots[x->taken++ % x->depth];
+        int success = px && line && trie;
+        s->state = SLOT_BUSY;
+        pthread_mutex_unlock(&x->lock);
+        if (success && x->format == EXPORT_PPM) {
+            success = export_ppm(x, s, px);
+        } else if (success && x->format == EXPORT_PNG) {
+            success = export_png(x, s, px, line);
+        } else if (success) {
+            success = export_gif(x, s, px, trie);
+        }
+        pthread_mutex_lock(&x->lock);
+        if (!success) x->failed = 1;
+        s->state = SLOT_DONE;
+        pthread_cond_broadcast(&x->changed);
+    }
+    pthread_mutex_unlock(&x->lock);
+    free(px);
+    free(line);
+    free(trie);
+
+    return NULL;
+}
+
+// Пишем готовый кадр: в GIF — следующим куском, иначе в свой файл. Имя файла кадра — путь экспорта
+// с номером поколения перед расширением: frames.png -> frames-00000042.png
+static int export_store(exporter *x, const export_slot *s) {
+    int success = 1;
+
+    if (x->format == EXPORT_GIF) {
+        success = fwrite(s->data, 1, s->size, x->out) == s->size;
+    } else {
+        size_t len = strlen(x->path);
+        const char *dot = strrchr(x->path, '.');  // Расширение есть всегда: по нему выбран формат
+        char *name = malloc(len + 32);
+        FILE *f = NULL;
+        if (name) {
+            snprintf(name, len + 32, "%.*s-%08llu%s", (int)(dot - x->path), x->path,
+                     (unsigned long long)s->generation, dot);
+            f = fopen(name, "wb");
+        }
+        success = f && fwrite(s->data, 1, s->size, f) == s->size;
+        if (f && fclose(f) != 0) success = 0;
+        free(name);
+    }
+
+    return success;
+}
+
+// Поток записи: пишет кадры строго по порядку, пока очередь не опустеет после закрытия.
+// После ошибки кадры только освобождаются, чтобы поток симуляции не ждал места
+void *export_writer(void *arg) {
+    exporter *x = arg;
+
+    pthread_mutex_lock(&x->lock);
+    for (;;) {
+        export_slot *s = &x->slots[x->written % x->depth];
+        while (s->state != SLOT_DONE && !(x->closing && x->written == x->submitted)) {
+            pthread_cond_wait(&x->changed, &x->lock);
+        }
+        if (s->state != SLOT_DONE) break;
+        int failed = x->failed;
+        pthread_mutex_unlock(&x->lock);
+        if (!failed && !export_store(x, s)) failed = 1;
+        pthread_mutex_lock(&x->lock);
+        x->failed |= failed;
+        s->state = SLOT_FREE;
+        x->written++;
+        pthread_cond_broadcast(&x->changed);
+    }
+    pthread_mutex_unlock(&x->lock);
+
+    return NULL;
+}
+
+// Отдаём поколение gen на экспорт: копируем поле в свободный кадр очереди. Ждём только при полной
+// очереди — кодирование или диск не успевают
+void export_frame(exporter *x, const bitfield *b, uint64_t gen) {
+    export_slot *s = &x->slots[x->submitted % x->depth];
+
+    pthread_mutex_lock(&x->lock);
+    while (s->state != SLOT_FREE) pthread_cond_wait(&x->changed, &x->lock);
+    pthread_mutex_unlock(&x->lock);
+    memcpy(s->cells->bits, b->bits, (size_t)b->height * b->words * sizeof(uint64_t));
+    s->generation = gen;
+    pthread_mutex_lock(&x->lock);
+    s->state = SLOT_QUEUED;
+    x->submitted++;
+    pthread_cond_broadcast(&x->changed);
+    pthread_mutex_unlock(&x->lock);
+}
+
+// Освобождаем очередь экспорта (потоки уже остановлены)
+static void export_free(exporter *x) {
+    for (int i = 0; x->slots && i < x->depth; i++) {
+        free_bitfield(x->slots[i].cells);
+        free(x->slots[i].data);
+    }
+    free(x->slots);
+    free(x->workers);
+    free_bitfield(x->pack);
+    x->slots = NULL;
+    x->workers = NULL;
+    x->pack = NULL;
+}
+
+// Останавливаем потоки экспорта: сначала кодирование (оно дописывает очередь), потом запись
+static void export_stop(exporter *x) {
+    pthread_mutex_lock(&x->lock);
+    x->closing = 1;
+    pthread_cond_broadcast(&x->changed);
+    pthread_mutex_unlock(&x->lock);
+    for (int i = 0; i < x->nworkers; i++) pthread_join(x->workers[i], NULL);
+    pthread_join(x->writer, NULL);
+    pthread_cond_destroy(&x->changed);
+    pthread_mutex_destroy(&x->lock);
+}
+
+// Открываем экспорт поля height x width: размер изображения, очередь на EXPORT_DEPTH кадров на поток,
+// потоки кодирования и записи; у GIF — заголовок с палитрой и бесконечным повтором. Первым кадром
+// export_frame получит начальное поколение, если оно кратно every
+int export_open(exporter *x, const options *opt, int height, int width) {
+    int success = 1;
+    long long ih = opt->export_shrink > 1 ? (height + opt->export_shrink - 1) / opt->export_shrink
+                                          : (long long)height * opt->export_scale;
+    long long iw = opt->export_shrink > 1 ? (width + opt->export_shrink - 1) / opt->export_shrink
+                                          : (long long)width * opt->export_scale;
+
+    memset(x, 0, sizeof(exporter));
+    x->path = opt->export;
+    x->format = opt->export_format;
+    x->scale = opt->export_scale;
+    x->shrink = opt->export_shrink;
+    x->every = opt->export_every ? (uint64_t)opt->export_every : 1;
+    x->nworkers = opt->export_threads ? opt->export_threads : online_cpus(EXPORT_WORKERS);
+    x->depth = x->nworkers * EXPORT_DEPTH;
+    // Изображение должно уместиться в формат: у GIF стороны 16-битные, у PNG чанк данных меньше 2 ГБ
+    if ((x->format == EXPORT_GIF && (iw > EXPORT_GIF_SIDE || ih > EXPORT_GIF_SIDE)) ||
+        iw > INT32_MAX / 4 || ih > INT32_MAX / 4 ||
+        (x->format == EXPORT_PNG && ((iw + 7) / 8 + 1) * ih > INT32_MAX / 2)) {
+        fprintf(stderr, "Export image %lldx%lld is too large for this format\n", iw, ih);
+        return 0;
+    }
+    x->image_height = (int)ih;
+    x->image_width = (int)iw;
+    crc_init();
+
+    x->slots = calloc((size_t)x->depth, sizeof(export_slot));
+    x->workers = calloc((size_t)x->nworkers, sizeof(pthread_t));
+    x->pack = create_bitfield(height, width);
+    success = x->slots && x->workers && x->pack;
+    for (int i = 0; success && i < x->depth; i++) {
+        x->slots[i].cells = create_bitfield(height, width);
+        success = x->slots[i].cells != NULL;
+    }
+    if (!success) fprintf(stderr, "Memory allocation error\n");
+    if (success && x->format == EXPORT_GIF) {
+        unsigned char head[13 + 6 + 19];
+        memcpy(head, "GIF89a", 6);
+        put_le(head + 6, (uint64_t)x->image_width, 2);
+        put_le(head + 8, (uint64_t)x->image_height, 2);
+        memcpy(head + 10, "\x80\x00\x00", 3);  // Общая палитра из двух цветов
+        memcpy(head + 13, export_palette, 6);
+        memcpy(head + 19, "\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19);  // Повторять без конца
+        x->out = fopen(x->path, "wb");
+        success = x->out && fwrite(head, 1, sizeof(head), x->out) == sizeof(head);
+        if (!success) fprintf(stderr, "Cannot open export file: %s\n", x->path);
+    }
+    if (success) {
+        pthread_mutex_init(&x->lock, NULL);
+        pthread_cond_init(&x->changed, NULL);
+        success = pthread_create(&x->writer, NULL, export_writer, x) == 0;
+        int started = 0;
+        while (success && started < x->nworkers &&
+               pthread_create(&x->workers[started], NULL, export_worker, x) == 0) {
+            started++;
+        }
+        if (success && started < x->nworkers) {  // Запущенные потоки останавливаем как при закрытии
+            x->nworkers = started;
+            export_stop(x);
+            success = 0;
+        } else if (!success) {
+            pthread_cond_destroy(&x->changed);
+            pthread_mutex_destroy(&x->lock);
+        }
+        if (!success) fprintf(stderr, "Cannot start export threads\n");
+    }
+    if (!success) {
+        if (x->out) fclose(x->out);
+        x->out = NULL;
+        export_free(x);
+    }
+
+    return success;
+}
+
+// Закрываем экспорт: дожидаемся, пока все кадры закодированы и записаны, и дописываем конец GIF.
+// Ошибки всплывают здесь
+int export_close(exporter *x) {
+    int success;
+
+    export_stop(x);
+    success = !x->failed;
+    if (x->out && (fputc(0x3B, x->out) == EOF || fclose(x->out) != 0)) success = 0;  // Конец GIF
+    x->out = NULL;
+    if (!success) fprintf(stderr, "Error writing export: %s\n", x->path);
+    export_free(x);
+
+    return success;
+}
+
+// Соседи слева для 64 клеток слова k: клетка j получает значение клетки j - 1.
+// Бит, вдвигаемый в начало строки, берётся из последней клетки строки (замыкание тора)
+static inline uint64_t bits_west(const uint64_t *row, int k, int words, int width) {
+    uint64_t carry = k > 0 ? row[k - 1] >> 63 : (row[words - 1] >> ((width - 1) % 64)) & 1;
+    return (row[k] << 1) | carry;
+}
+
+// Соседи справа для 64 клеток слова k: клетка j получает значение клетки j + 1.
+// В последнюю клетку строки вдвигается первая клетка строки (замыкание тора)
+static inline uint64_t bits_east(const uint64_t *row, int k, int words, int width) {
+    uint64_t carry = k < words - 1 ? row[k + 1] << 63 : (row[0] & 1) << ((width - 1) % 64);
+    return (row[k] >> 1) | carry;
+}
+
+// Следующее состояние 64 клеток слова k строки mid по строкам up и down.
+// Восемь соседей складываются побитовыми сумматорами сразу для всех 64 клеток
+static inline uint64_t bits_life_word(const uint64_t *up, const uint64_t *mid, const uint64_t *down, int k,
+                                      int words, int width) {
+    uint64_t uw = bits_west(up, k, words, width), ue = bits_east(up, k, words, width), u = up[k];
+    uint64_t mw = bits_west(mid, k, words, width), me = bits_east(mid, k, words, width), m = mid[k];
+    uint64_t dw = bits_west(down, k, words, width), de = bits_east(down, k, words, width), d = down[k];
+
+    uint64_t u0 = uw ^ u ^ ue, u1 = (uw & u) | (ue & (uw ^ u));  // Сумма трёх верхних соседей (0..3)
+    uint64_t d0 = dw ^ d ^ de, d1 = (dw & d) | (de & (dw ^ d));  // Сумма трёх нижних соседей (0..3)
+    uint64_t m0 = mw ^ me, m1 = mw & me;                         // Сумма двух боковых соседей (0..2)
+
+    uint64_t s0 = u0 ^ d0 ^ m0;                      // Младший бит числа соседей
+    uint64_t c0 = (u0 & d0) | (m0 & (u0 ^ d0));      // Перенос во второй разряд
+    uint64_t t = u1 ^ d1 ^ m1;                       // Второй разряд без переноса
+    uint64_t c1 = (u1 & d1) | (m1 & (u1 ^ d1));      // Перенос в третий разряд
+    uint64_t s1 = t ^ c0;                            // Второй бит числа соседей
+    uint64_t s2 = c1 ^ (t & c0);                     // Третий бит (8 соседей дают 0 по модулю 8)
+
+    // Живая при 2 или 3 соседях: s2 = 0, s1 = 1; при двух соседях клетка должна была быть живой
+    return s1 & ~s2 & (s0 | m);
+}
+
+// Следующее состояние 64 клеток слова k для любого правила: число соседей собирается в четыре
+// битовые плоскости, и для каждого n из масок проверяется равенство. С константными масками
+// остаются только нужные проверки
+static ALWAYS_INLINE uint64_t bits_rule_word(const uint64_t *up, const uint64_t *mid, const uint64_t *down,
+                                             int k, int words, int width, unsigned birth, unsigned survive) {
+    uint64_t uw = bits_west(up, k, words, width), ue = bits_east(up, k, words, width), u = up[k];
+    uint64_t mw = bits_west(mid, k, words, width), me = bits_east(mid, k, words, width), m = mid[k];
+    uint64_t dw = bits_west(down, k, words, width), de = bits_east(down, k, words, width), d = down[k];
+
+    uint64_t u0 = uw ^ u ^ ue, u1 = (uw & u) | (ue & (uw ^ u));
+    uint64_t d0 = dw ^ d ^ de, d1 = (dw & d) | (de & (dw ^ d));
+    uint64_t m0 = mw ^ me, m1 = mw & me;
+
+    uint64_t s0 = u0 ^ d0 ^ m0, c0 = (u0 & d0) | (m0 & (u0 ^ d0));
+    uint64_t t = u1 ^ d1 ^ m1, c1 = (u1 & d1) | (m1 & (u1 ^ d1));
+    uint64_t s1 = t ^ c0, s2 = c1 ^ (t & c0), s3 = c1 & t & c0;  // s3 — ровно 8 соседей
+    uint64_t born = 0, keep = 0;
+
+    for (int n = 0; n <= 8; n++) {
+        if (!((birth | survive) >> n & 1)) continue;
+        uint64_t eq = (n & 1 ? s0 : ~s0) & (n & 2 ? s1 : ~s1) & (n & 4 ? s2 : ~s2) & (n & 8 ? s3 : ~s3);
+        if (birth >> n & 1) born |= eq;
+        if (survive >> n & 1) keep |= eq;
+    }
+
+    return (born & ~m) | (keep & m);
+}
+
+// Ядра битового движка для B3/S23 — на вручную сокращённой логике bits_life_word
+static uint64_t bits_word_conway(const uint64_t *up, const uint64_t *mid, const uint64_t *down, int k,
+                                 int words, int width) {
+    return bits_life_word(up, mid, down, k, words, width);
+}
+
+static void bits_row_conway(const uint64_t *up, const uint64_t *mid, const uint64_t *down, uint64_t *out,
+                            int words, int width) {
+    for (int k = 0; k < words; k++) out[k] = bits_life_word(up, mid, down, k, words, width);
+}
+
+// Ядра битового движка для правила с константными масками
+#define BITS_KERNELS(name, birth, survive)                                                                   \
+    static uint64_t bits_word_##name(const uint64_t *up, const uint64_t *mid, const uint64_t *down, int k,   \
+                                     int words, int width) {                                                 \
+        return bits_rule_word(up, mid, down, k, words, width, birth, survive);                               \
+    }                                                                                                        \
+    static void bits_row_##name(const uint64_t *up, const uint64_t *mid, const uint64_t *down,               \
+                                uint64_t *out, int words, int width) {                                       \
+        for (int k = 0; k < words; k++)                                                                      \
+            out[k] = bits_rule_word(up, mid, down, k, words, width, birth, survive);                         \
+    }
+
+BITS_KERNELS(highlife, 0x048u, 0x00Cu)
+BITS_KERNELS(daynight, 0x1C8u, 0x1D8u)
+BITS_KERNELS(seeds, 0x004u, 0x000u)
+BITS_KERNELS(any, life_rule.birth, life_rule.survive)  // Любое правило: маски читаются из life_rule
+
+static bits_row_fn bits_row = bits_row_conway;     // Ядра битового движка для текущего правила (rule_init)
+static bits_word_fn bits_word = bits_word_conway;
+
+// Вычисление строк [from, to) следующего поколения на битовом поле: по 64 клетки за операцию
+void next_gen_bits_rows(const bitfield *curr, bitfield *next, int from, int to, gen_stats *st) {
+    int h = curr->height, n = curr->words;
+
+    for (int i = from; i < to; i++) {
+        const uint64_t *up = curr->bits + (size_t)((i - 1 + h) % h) * n;  // Строка выше (с замыканием)
+        const uint64_t *mid = curr->bits + (size_t)i * n;                // Текущая строка
+        const uint64_t *down = curr->bits + (size_t)((i + 1) % h) * n;   // Строка ниже (с замыканием)
+        uint64_t *out = next->bits + (size_t)i * n;
+
+        bits_row(up, mid, down, out, n, curr->width);
+        out[n - 1] &= curr->tail;  // Биты за правым краем строки всегда мёртвые
+        if (st) stats_row_bits(st, mid, out, n, i);
+    }
+}
+
+// Вычисление следующего поколения всего битового поля
+void next_gen_bits(const bitfield *curr, bitfield *next) {
+    next_gen_bits_rows(curr, next, 0, curr->height, NULL);
+}
+
+// 64 клетки строки тора подряд, начиная со столбца col (любого, берётся по модулю ширины)
+static uint64_t bits_cells(const uint64_t *row, int64_t col, int width) {
+    uint64_t word = 0;
+
+    col = (col % width + width) % width;
+    if (col % 64 == 0 && col + 64 <= width) return row[col / 64];  // Обычное слово строки
+    for (int got = 0; got < 64;) {  // Слово на стыке слов или через край тора — собираем кусками
+        int bit = (int)(col % 64), take = 64 - bit;
+        if (take > width - col) take = (int)(width - col);
+        if (take > 64 - got) take = 64 - got;
+        uint64_t part = row[col / 64] >> bit;
+        if (take < 64) part &= ((uint64_t)1 << take) - 1;
+        word |= part << got;
+        got += take;
+        col = (col + take) % width;
+    }
+    return word;
+}
+
+// Высота плитки временного блока k без рамки. Трапеция над плиткой в среднем на k строк выше самой
+// плитки, так что при высоте 8k лишней работы около восьмой части, а два буфера плитки при k = 64
+// занимают около 350 КБ и остаются в L2
+static int temporal_height(int k) {
+    return 8 * k > 32 ? 8 * k : 32;
+}
+
+// Слов в буфере плиток одного потока для временного блока k: два поколения плитки с рамкой
+size_t temporal_words(int k) {
+    return 2 * (size_t)(temporal_height(k) + 2 * k) * (TEMPORAL_WORDS + 2);
+}
+
+// Строки [from, to) поколения через k шагов (k <= TEMPORAL_MAX) временными блоками: плитка
+// TEMPORAL_WORDS слов вместе с рамкой в k строк сверху и снизу и в слово слева и справа копируется
+// в scratch и проходит там все k поколений, пока лежит в L1/L2, а в next уходит только её середина.
+// Поле читается и пишется один раз за k поколений. Верная часть плитки с каждым шагом сужается на
+// строку и на клетку с каждой стороны (трапеция); боковой рамки в 64 клетки хватает на k <= 64 шагов,
+// а мусор, который замыкание строки плитки вдвигает в её крайние биты, до середины не доходит
+void temporal_rows(const bitfield *curr, bitfield *next, int from, int to, int k, uint64_t *scratch) {
+    int n = curr->words, h = curr->height, rows = temporal_height(k);
+
+    for (int top = from; top < to; top += rows) {
+        int th = top + rows < to ? rows : to - top, r = th + 2 * k;
+        for (int w0 = 0; w0 < n; w0 += TEMPORAL_WORDS) {
+            int tw = w0 + TEMPORAL_WORDS < n ? TEMPORAL_WORDS : n - w0, m = tw + 2;
+            uint64_t *a = scratch, *b = scratch + (size_t)r * m;
+            // Рамка не выходит за край строки и не задевает хвостового слова — плитка копируется словами
+            int inner = w0 > 0 && (w0 + tw < n - 1 || (w0 + tw < n && curr->width % 64 == 0));
+            for (int i = 0; i < r; i++) {  // Плитка с рамкой; строки и столбцы за краем — по модулю тора
+                const uint64_t *src = curr->bits + (size_t)(((top - k + i) % h + h) % h) * n;
+                if (inner) {
+                    memcpy(a + (size_t)i * m, src + w0 - 1, (size_t)m * sizeof(uint64_t));
+                    continue;
+                }
+                for (int x = 0; x < m; x++) {
+                    a[(size_t)i * m + x] = bits_cells(src, (int64_t)(w0 + x - 1) * 64, curr->width);
+                }
+            }
+            for (int g = 1; g <= k; g++) {  // Шаг g верен для строк [g, r - g)
+                for (int i = g; i < r - g; i++) {
+                    bits_row(a + (size_t)(i - 1) * m, a + (size_t)i * m, a + (size_t)(i + 1) * m,
+                             b + (size_t)i * m, m, m * 64);
+                }
+                uint64_t *tmp = a;
+                a = b;
+                b = tmp;
+            }
+            for (int i = 0; i < th; i++) {
+                uint64_t *out = next->bits + (size_t)(top + i) * n + w0;
+                memcpy(out, a + (size_t)(k + i) * m + 1, (size_t)tw * sizeof(uint64_t));
+                if (w0 + tw == n) out[tw - 1] &= curr->tail;  // Клетки за краем строки — копии начала
+            }
+        }
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+// Ядро строки на SSE2 для B3/S23: 16 клеток за итерацию, соседи складываются в байтовых дорожках
+__attribute__((target("sse2"))) static void life_row_sse2(const unsigned char *up, const unsigned char *mid,
+                                                           const unsigned char *down, unsigned char *out,
+                                                           int n) {
+    const __m128i one = _mm_set1_epi8(1), two = _mm_set1_epi8(2), three = _mm_set1_epi8(3);
+
+    for (int j = 0; j < n; j += 16) {
+        __m128i s = _mm_add_epi8(_mm_loadu_si128((const __m128i *)(up + j)),
+                                 _mm_loadu_si128((const __m128i *)(up + j + 1)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(up + j + 2)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(mid + j)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(mid + j + 2)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(down + j)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(down + j + 1)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(down + j + 2)));
+        __m128i alive = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(mid + j + 1)), one);
+        // Рождение при трёх соседях или выживание при двух; сравнение даёт 0xFF, оставляем младший бит
+        __m128i res = _mm_or_si128(_mm_cmpeq_epi8(s, three), _mm_and_si128(_mm_cmpeq_epi8(s, two), alive));
+        _mm_storeu_si128((__m128i *)(out + j), _mm_and_si128(res, one));
+    }
+}
+
+// Ядро строки на SSSE3 для любого правила: 16 клеток за итерацию, следующее состояние по числу
+// соседей берётся из таблиц правила одной командой pshufb
+__attribute__((target("ssse3"))) static void life_row_ssse3(const unsigned char *up, const unsigned char *mid,
+                                                             const unsigned char *down, unsigned char *out,
+                                                             int n) {
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i born = _mm_loadu_si128((const __m128i *)life_rule.born);
+    const __m128i keep = _mm_loadu_si128((const __m128i *)life_rule.keep);
+
+    for (int j = 0; j < n; j += 16) {
+        __m128i s = _mm_add_epi8(_mm_loadu_si128((const __m128i *)(up + j)),
+                                 _mm_loadu_si128((const __m128i *)(up + j + 1)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(up + j + 2)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(mid + j)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(mid + j + 2)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(down + j)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(down + j + 1)));
+        s = _mm_add_epi8(s, _mm_loadu_si128((const __m128i *)(down + j + 2)));
+        __m128i alive = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(mid + j + 1)), one);
+        __m128i res = _mm_or_si128(_mm_andnot_si128(alive, _mm_shuffle_epi8(born, s)),
+                                   _mm_and_si128(alive, _mm_shuffle_epi8(keep, s)));
+        _mm_storeu_si128((__m128i *)(out + j), res);
+    }
+}
+
+// Ядро строки на AVX2 для любого правила: 32 клетки за итерацию, таблицы правила в обеих половинах регистра
+__attribute__((target("avx2"))) static void life_row_avx2(const unsigned char *up, const unsigned char *mid,
+                                                           const unsigned char *down, unsigned char *out,
+                                                           int n) {
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i born = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)life_rule.born));
+    const __m256i keep = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)life_rule.keep));
+
+    for (int j = 0; j < n; j += 32) {
+        __m256i s = _mm256_add_epi8(_mm256_loadu_si256((const __m256i *)(up + j)),
+                                    _mm256_loadu_si256((const __m256i *)(up + j + 1)));
+        s = _mm256_add_epi8(s, _mm256_loadu_si256((const __m256i *)(up + j + 2)));
+        s = _mm256_add_epi8(s, _mm256_loadu_si256((const __m256i *)(mid + j)));
+        s = _mm256_add_epi8(s, _mm256_loadu_si256((const __m256i *)(mid + j + 2)));
+        s = _mm256_add_epi8(s, _mm256_loadu_si256((const __m256i *)(down + j)));
+        s = _mm256_add_epi8(s, _mm256_loadu_si256((const __m256i *)(down + j + 1)));
+        s = _mm256_add_epi8(s, _mm256_loadu_si256((const __m256i *)(down + j + 2)));
+        __m256i alive = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(mid + j + 1)), one);
+        __m256i res = _mm256_blendv_epi8(_mm256_shuffle_epi8(born, s), _mm256_shuffle_epi8(keep, s), alive);
+        _mm256_storeu_si256((__m256i *)(out + j), res);
+    }
+}
+#endif
+
+static life_row_fn life_row = NULL;  // Ядро строки, выбранное под текущий процессор
+const char *simd_isa = "scalar";     // Название выбранного набора инструкций
+
+// Выбираем лучшее ядро строки, которое поддерживает процессор, для текущего правила. Таблицы pshufb
+// (SSSE3, AVX2) подходят любому правилу, сравнения SSE2 — только B3/S23, иначе — ядро правила,
+// которое векторизует компилятор
+void simd_init(void) {
+    int conway = life_rule.birth == LIFE_BIRTH && life_rule.survive == LIFE_SURVIVE;
+
+    life_row = rule_row;
+    simd_isa = "scalar";
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        life_row = life_row_avx2;
+        simd_isa = "avx2";
+    } else if (__builtin_cpu_supports("ssse3")) {
+        life_row = life_row_ssse3;
+        simd_isa = "ssse3";
+    } else if (conway && __builtin_cpu_supports("sse2")) {
+        life_row = life_row_sse2;
+        simd_isa = "sse2";
+    }
+#endif
+}
+
+// Ядра одного правила для всех движков
+typedef struct {
+    unsigned birth;       // Маски правила
+    unsigned survive;
+    life_row_fn row;      // Ядро строки с клетками в байтах (halo, запасной вариант simd)
+    bits_row_fn bits;     // Ядро строки битового движка
+    bits_word_fn word;    // Ядро слова битового движка (плитки)
+} rule_kernels;
+
+// Правила со специализированными ядрами; остальные считают ядра *_any по таблицам life_rule
+static const rule_kernels known_rules[] = {
+    {LIFE_BIRTH, LIFE_SURVIVE, rule_row_conway, bits_row_conway, bits_word_conway},  // Conway
+    {0x048u, 0x00Cu, rule_row_highlife, bits_row_highlife, bits_word_highlife},       // HighLife
+    {0x1C8u, 0x1D8u, rule_row_daynight, bits_row_daynight, bits_word_daynight},       // Day & Night
+    {0x004u, 0x000u, rule_row_seeds, bits_row_seeds, bits_word_seeds},                // Seeds
+};
+
+// Может ли движок считать по правилу: с B0 пустота оживает, а бесконечные плоскости Hashlife и chunks
+// держатся на том, что пустые квадраты и участки остаются пустыми
+int rule_supported(int type, const rule *r) {
+    return (type != ENGINE_HASHLIFE && type != ENGINE_CHUNKS) || !(r->birth & 1);
+}
+
+// Делаем r текущим правилом и выбираем его ядра (вызывается до создания движков)
+void rule_init(const rule *r) {
+    life_rule = *r;
+    rule_row = rule_row_any;
+    bits_row = bits_row_any;
+    bits_word = bits_word_any;
+    for (size_t i = 0; i < sizeof(known_rules) / sizeof(known_rules[0]); i++) {
+        if (known_rules[i].birth == r->birth && known_rules[i].survive == r->survive) {
+            rule_row = known_rules[i].row;
+            bits_row = known_rules[i].bits;
+            bits_word = known_rules[i].word;
+        }
+    }
+    simd_init();
+}
+
+// Длина одной расширенной строки: призрачный столбец слева, stride клеток и запас на чтение за краем
+static size_t simd_line_len(const field *f) { return (size_t)f->stride + CACHE_LINE; }
+
+// Строим расширенную строку: слева последняя клетка строки, справа первая (замыкание тора)
+static void simd_extend_row(const field *f, int i, unsigned char *ext) {
+    const unsigned char *row = f->cells + (size_t)i * f->stride;
+
+    ext[0] = row[f->width - 1];
+    memcpy(ext + 1, row, (size_t)f->width);
+    ext[f->width + 1] = row[0];
+}
+
+// Вычисление строк [from, to) векторным движком: строки расширяются по одной и
+// переиспользуются скользящим окном из трёх буферов line
+void next_gen_simd_rows(const field *curr, field *next, unsigned char *line, int from, int to,
+                        gen_stats *st) {
+    int h = curr->height;
+    size_t len = simd_line_len(curr);  // Длина одного расширенного буфера
+    unsigned char *up = line, *mid = line + len, *down = line + 2 * len;
+
+    if (from >= to) return;  // Пустая полоса (потоков больше, чем строк)
+    simd_extend_row(curr, (from - 1 + h) % h, up);  // Строка над первой строкой полосы (с замыканием)
+    simd_extend_row(curr, from, mid);
+    for (int i = from; i < to; i++) {
+        simd_extend_row(curr, (i + 1) % h, down);
+        life_row(up, mid, down, next->cells + (size_t)i * next->stride, curr->stride);
+        if (st) stats_row_bytes(st, mid + 1, next->cells + (size_t)i * next->stride, curr->width, i);
+
+        unsigned char *tmp = up;  // Сдвигаем окно на одну строку вниз
+        up = mid;
+        mid = down;
+        down = tmp;
+    }
+}
+
+// Вычисление следующего поколения всего поля векторным движком
+void next_gen_simd(const field *curr, field *next, unsigned char *line) {
+    next_gen_simd_rows(curr, next, line, 0, curr->height, NULL);
+}
+
+// Перемешивание битов для хеша узла по адресам четвертей
+static size_t hl_hash(const hl_node *nw, const hl_node *ne, const hl_node *sw, const hl_node *se) {
+    uint64_t h = (uintptr_t)nw * 0x9E3779B97F4A7C15ull;
+    h = (h ^ (uintptr_t)ne) * 0xC2B2AE3D27D4EB4Full;
+    h = (h ^ (uintptr_t)sw) * 0x165667B19E3779F9ull;
+    h = (h ^ (uintptr_t)se) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h ^ (h >> 29));
+}
+
+// Увеличиваем хеш-таблицу вдвое и раскладываем узлы по новым корзинам
+static int hl_grow(hashlife *h) {
+    size_t buckets = h->buckets * 2;
+    hl_node **table = calloc(buckets, sizeof(hl_node *));
+
+    if (table) {
+        for (size_t b = 0; b < h->buckets; b++) {
+            hl_node *n = h->table[b];
+            while (n) {
+                hl_node *next = n->hnext;
+                size_t k = hl_hash(n->nw, n->ne, n->sw, n->se) & (buckets - 1);
+                n->hnext = table[k];
+                table[k] = n;
+                n = next;
+            }
+        }
+        free(h->table);
+        h->table = table;
+        h->buckets = buckets;
+    }
+
+    return table != NULL;
+}
+
+// Единственный узел с данными четвертями: находим в таблице или создаём (NULL — нет памяти)
+hl_node *hl_join(hashlife *h, hl_node *nw, hl_node *ne, hl_node *sw, hl_node *se) {
+    size_t k = hl_hash(nw, ne, sw, se) & (h->buckets - 1);
+    hl_node *n = h->table[k];
+
+    while (n && !(n->nw == nw && n->ne == ne && n->sw == sw && n->se == se)) n = n->hnext;
+    if (!n && h->count >= h->buckets / 4 * 3 && hl_grow(h)) k = hl_hash(nw, ne, sw, se) & (h->buckets - 1);
+    if (!n && !h->free_list) {  // Свободных узлов нет — выделяем новый блок
+        hl_block *b = malloc(sizeof(hl_block));
+        if (b) {
+            b->next = h->blocks;
+            h->blocks = b;
+            for (int i = 0; i < HL_BLOCK; i++) {
+                b->nodes[i].level = -1;
+                b->nodes[i].hnext = h->free_list;
+                h->free_list = &b->nodes[i];
+            }
+        }
+    }
+    if (!n && h->free_list) {
+        n = h->free_list;
+        h->free_list = n->hnext;
+        n->nw = nw;
+        n->ne = ne;
+        n->sw = sw;
+        n->se = se;
+        n->result = NULL;
+        n->rstep = 0;
+        n->mark = 0;
+        n->level = nw->level + 1;
+        n->population = nw->population + ne->population + sw->population + se->population;
+        n->hnext = h->table[k];
+        h->table[k] = n;
+        h->count++;
+    }
+
+    return n;
+}
+
+// Центральный квадрат уровня level - 1 (без продвижения во времени)
+static hl_node *hl_centre(hashlife *h, const hl_node *n) {
+    return hl_join(h, n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+// Состояние клетки (y, x) внутри квадрата 4x4 уровня 2
+static int hl_cell4(const hl_node *n, int y, int x) {
+    const hl_node *q = y < 2 ? (x < 2 ? n->nw : n->ne) : (x < 2 ? n->sw : n->se);
+    const hl_node *c = (y & 1) ? ((x & 1) ? q->se : q->sw) : ((x & 1) ? q->ne : q->nw);
+    return (int)c->population;
+}
+
+// Базовый случай: центр 2x2 квадрата 4x4 через одно поколение, считаем напрямую
+static hl_node *hl_base(hashlife *h, const hl_node *n) {
+    hl_node *c[4];
+
+    for (int k = 0; k < 4; k++) {
+        int y = 1 + k / 2, x = 1 + k % 2, count = 0;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if (dy || dx) count += hl_cell4(n, y + dy, x + dx);
+            }
+        }
+        int alive = hl_cell4(n, y, x);
+        c[k] = &h->leaf[alive ? life_rule.keep[count] : life_rule.born[count]];
+    }
+
+    return hl_join(h, c[0], c[1], c[2], c[3]);
+}
+
+// Центр узла уровня level - 1 через 2^min(step, level - 2) поколений. Девять перекрывающихся
+// подквадратов продвигаются на первую половину шага (или просто центрируются, если шаг меньше
+// максимального), затем четыре их объединения — на вторую. Результат запоминается в узле
+hl_node *hl_result(hashlife *h, hl_node *n) {
+    int step = h->step < n->level - 2 ? h->step : n->level - 2;  // Шаг для этого уровня
+    hl_node *r = NULL;
+
+    if (n->result && n->rstep == step) {
+        r = n->result;  // Уже вычислено для этого шага
+    } else if (n->population == 0) {
+        r = h->empty[n->level - 1];  // Пустой квадрат остаётся пустым
+    } else if (n->level == 2) {
+        r = hl_base(h, n);
+    } else {
+        hl_node *q[9] = {n->nw,
+                         hl_join(h, n->nw->ne, n->ne->nw, n->nw->se, n->ne->sw),
+                         n->ne,
+                         hl_join(h, n->nw->sw, n->nw->se, n->sw->nw, n->sw->ne),
+                         hl_join(h, n->nw->se, n->ne->sw, n->sw->ne, n->se->nw),
+                         hl_join(h, n->ne->sw, n->ne->se, n->se->nw, n->se->ne),
+                         n->sw,
+                         hl_join(h, n->sw->ne, n->se->nw, n->sw->se, n->se->sw),
+                         n->se};
+        hl_node *a[9];
+        int ok = 1;
+
+        for (int i = 0; i < 9 && ok; i++) {
+            if (!q[i]) ok = 0;  // Не хватило памяти под узел
+            else a[i] = step == n->level - 2 ? hl_result(h, q[i]) : hl_centre(h, q[i]);
+            if (ok && !a[i]) ok = 0;
+        }
+        if (ok) {
+            hl_node *b[4] = {hl_join(h, a[0], a[1], a[3], a[4]), hl_join(h, a[1], a[2], a[4], a[5]),
+                             hl_join(h, a[3], a[4], a[6], a[7]), hl_join(h, a[4], a[5], a[7], a[8])};
+            for (int i = 0; i < 4 && ok; i++) {
+                b[i] = b[i] ? hl_result(h, b[i]) : NULL;
+                if (!b[i]) ok = 0;
+            }
+            if (ok) r = hl_join(h, b[0], b[1], b[2], b[3]);
+        }
+    }
+    if (r) {
+        n->result = r;
+        n->rstep = step;
+    }
+
+    return r;
+}
+
+void free_hashlife(hashlife *h);
+
+// Создаём пустую вселенную Hashlife
+hashlife *create_hashlife(void) {
+    hashlife *h = calloc(1, sizeof(hashlife));
+
+    if (h) {
+        h->buckets = 1 << 16;
+        h->table = calloc(h->buckets, sizeof(hl_node *));
+        h->limit = HL_GC_NODES;
+        h->leaf[1].population = 1;  // Живая клетка; у мёртвой population = 0
+        h->empty[0] = &h->leaf[0];
+        for (int l = 1; l <= HL_MAX_LEVEL && h->table; l++) {
+            h->empty[l] = hl_join(h, h->empty[l - 1], h->empty[l - 1], h->empty[l - 1], h->empty[l - 1]);
+            if (!h->empty[l]) l = HL_MAX_LEVEL + 1;  // Нет памяти — прекращаем
+        }
+        if (!h->table || !h->empty[HL_MAX_LEVEL]) {
+            free_hashlife(h);
+            h = NULL;
+        } else {
+            h->root = h->empty[3];
+        }
+    }
+
+    return h;
+}
+
+// Освобождаем вселенную Hashlife со всеми узлами
+void free_hashlife(hashlife *h) {
+    if (h) {
+        while (h->blocks) {
+            hl_block *next = h->blocks->next;
+            free(h->blocks);
+            h->blocks = next;
+        }
+        free(h->table);
+        free(h);
+    }
+}
+
+// Отмечаем узел и всех его потомков как используемые
+static void hl_mark(hashlife *h, hl_node *n) {
+    while (n && n->level > 0 && n->mark != h->epoch) {
+        n->mark = h->epoch;
+        hl_mark(h, n->nw);
+        hl_mark(h, n->ne);
+        hl_mark(h, n->sw);
+        n = n->se;  // Последнюю четверть обходим без рекурсии
+    }
+}
+
+// Сборка мусора: остаются узлы, достижимые из корня, и пустые квадраты. Запомненные
+// результаты, указывающие на освобождённые узлы, забываются
+void hl_collect(hashlife *h) {
+    h->epoch++;
+    hl_mark(h, h->root);
+    for (int l = 1; l <= HL_MAX_LEVEL; l++) h->empty[l]->mark = h->epoch;
+
+    memset(h->table, 0, h->buckets * sizeof(hl_node *));
+    h->count = 0;
+    h->free_list = NULL;
+    for (hl_block *b = h->blocks; b; b = b->next) {
+        for (int i = 0; i < HL_BLOCK; i++) {
+            hl_node *n = &b->nodes[i];
+            if (n->level >= 0 && n->mark == h->epoch) {  // Живой узел — обратно в таблицу
+                size_t k = hl_hash(n->nw, n->ne, n->sw, n->se) & (h->buckets - 1);
+                if (n->result && n->result->mark != h->epoch) n->result = NULL;  // Результат освобождается
+                n->hnext = h->table[k];
+                h->table[k] = n;
+                h->count++;
+            } else {  // Мусор — в список свободных
+                n->level = -1;
+                n->hnext = h->free_list;
+                h->free_list = n;
+            }
+        }
+    }
+    if (h->count > h->limit / 4 * 3) h->limit *= 2;  // Живых узлов слишком много — реже собираем мусор
+}
+
+// Строим квадрат уровня level с левым верхним углом (top, left) по клеткам поля
+static hl_node *hl_build(hashlife *h, const field *f, int64_t top, int64_t left, int level) {
+    hl_node *n = NULL;
+    int64_t size = (int64_t)1 << level;
+
+    if (top >= f->height || left >= f->width) {
+        n = h->empty[level];  // Квадрат целиком за пределами поля
+    } else if (level == 0) {
+        n = &h->leaf[CELL(f, top, left) != 0];
+    } else {
+        int64_t half = size / 2;
+        hl_node *nw = hl_build(h, f, top, left, level - 1), *ne = hl_build(h, f, top, left + half, level - 1);
+        hl_node *sw = hl_build(h, f, top + half, left, level - 1);
+        hl_node *se = hl_build(h, f, top + half, left + half, level - 1);
+        if (nw && ne && sw && se) n = hl_join(h, nw, ne, sw, se);
+    }
+
+    return n;
+}
+
+// Загружаем поле на плоскость: левый верхний угол поля — клетка (0, 0)
+int hashlife_load(hashlife *h, const field *f) {
+    int level = 3;  // Корень не меньше 8x8, чтобы у него были внуки
+
+    while (((int64_t)1 << level) < f->height || ((int64_t)1 << level) < f->width) level++;
+    hl_node *root = hl_build(h, f, 0, 0, level);
+    if (root) {
+        h->root = root;
+        h->top = 0;
+        h->left = 0;
+    }
+
+    return root != NULL;
+}
+
+// Достраиваем вокруг корня пустую рамку: уровень растёт на 1, старый корень оказывается в центре
+static hl_node *hl_expand(hashlife *h, hl_node *n) {
+    hl_node *e = h->empty[n->level - 1];
+    hl_node *r = NULL;
+
+    if (n->level < HL_MAX_LEVEL) {
+        hl_node *nw = hl_join(h, e, e, e, n->nw), *ne = hl_join(h, e, e, n->ne, e);
+        hl_node *sw = hl_join(h, e, n->sw, e, e), *se = hl_join(h, n->se, e, e, e);
+        if (nw && ne && sw && se) r = hl_join(h, nw, ne, sw, se);
+    }
+
+    return r;
+}
+
+// Узор корня целиком лежит в квадрате depth раз взятого центра (NULL-узел — нет памяти, не лежит)
+static int hl_inside(hashlife *h, hl_node *root, int depth) {
+    hl_node *c = root;
+
+    for (int d = 0; d < depth && c; d++) c = c->level > 1 ? hl_centre(h, c) : NULL;
+
+    return c && c->population == root->population;
+}
+
+// Продвигаем корень на 2^step поколений. Сначала корень расширяется, пока узор не окажется
+// в центральной четверти центра, а уровень не станет больше step + 2 — тогда за 2^step
+// поколений узор не выйдет за центр, который и возвращает hl_result
+static int hashlife_jump(hashlife *h, int step) {
+    int success = 1;
+    hl_node *root = h->root;
+
+    while (success && (root->level < step + 3 || !hl_inside(h, root, 2))) {
+        hl_node *r = hl_expand(h, root);
+        if (r) {
+            h->top -= (int64_t)1 << (root->level - 1);  // Старый корень сдвинулся на половину своей стороны
+            h->left -= (int64_t)1 << (root->level - 1);
+            root = r;
+        } else {
+            success = 0;  // Плоскость слишком велика или кончилась память
+        }
+    }
+    if (success) {
+        h->step = step;
+        hl_node *r = hl_result(h, root);
+        if (r) {
+            h->top += (int64_t)1 << (root->level - 2);  // Центр смещён на четверть стороны корня
+            h->left += (int64_t)1 << (root->level - 2);
+            root = r;
+        } else {
+            success = 0;
+        }
+    }
+    // Обрезаем пустую рамку, чтобы корень не рос без нужды
+    while (success && root->level > 3 && hl_inside(h, root, 1)) {
+        h->top += (int64_t)1 << (root->level - 2);
+        h->left += (int64_t)1 << (root->level - 2);
+        root = hl_centre(h, root);
+    }
+    h->root = root;
+    if (h->count > h->limit) hl_collect(h);
+
+    return success;
+}
+
+// Продвигаем вселенную на gens поколений: каждый единичный бит числа — один прыжок на 2^k
+int hashlife_advance(hashlife *h, uint64_t gens) {
+    int success = 1;
+
+    for (int k = 0; k < 64 && success; k++) {
+        if ((gens >> k) & 1) success = hashlife_jump(h, k);
+    }
+
+    return success;
+}
+
+// Переносим клетки квадрата n с левым верхним углом (top, left) в поле f (окно 0..height, 0..width)
+static void hl_fill(const hl_node *n, int64_t top, int64_t left, field *f) {
+    int64_t size = (int64_t)1 << n->level;
+
+    if (n->population == 0 || top >= f->height || left >= f->width || top + size <= 0 || left + size <= 0) {
+        return;  // Пустой квадрат или квадрат вне окна — клетки уже мёртвые
+    }
+    if (n->level == 0) {
+        CELL(f, top, left) = 1;
+    } else {
+        int64_t half = size / 2;
+        hl_fill(n->nw, top, left, f);
+        hl_fill(n->ne, top, left + half, f);
+        hl_fill(n->sw, top + half, left, f);
+        hl_fill(n->se, top + half, left + half, f);
+    }
+}
+
+// Выгружаем окно плоскости, совпадающее с исходным полем, в обычное поле (для отрисовки)
+void hashlife_store(const hashlife *h, field *f) {
+    memset(f->cells, 0, (size_t)f->height * f->stride);
+    hl_fill(h->root, h->top, h->left, f);
+}
+
+// Крайняя живая клетка непустого квадрата n со стороны side (0 — верх, 1 — низ, 2 — лево, 3 — право):
+// её строка (side 0, 1) или столбец (side 2, 3) от угла квадрата. Пустые четверти пропускаются по
+// population, поэтому спуск идёт только вдоль нужного края узора
+static int64_t hl_edge(const hl_node *n, int side) {
+    if (n->level == 0) return 0;
+
+    int64_t half = (int64_t)1 << (n->level - 1), best = -1;
+    int high = side & 1;  // Ищем наибольшую координату
+    const hl_node *lo[2] = {n->nw, side < 2 ? n->ne : n->sw};  // Половина с меньшими координатами
+    const hl_node *hi[2] = {side < 2 ? n->sw : n->ne, n->se};
+    const hl_node **near = high ? hi : lo, **far = high ? lo : hi;  // Ближняя к стороне половина — первой
+
+    for (int k = 0; k < 2; k++) {
+        int64_t v = near[k]->population ? (high ? half : 0) + hl_edge(near[k], side) : -1;
+        if (v >= 0 && (best < 0 || (high ? v > best : v < best))) best = v;
+    }
+    for (int k = 0; k < 2 && !near[0]->population && !near[1]->population; k++) {  // Ближняя половина пуста
+        int64_t v = far[k]->population ? (high ? 0 : half) + hl_edge(far[k], side) : -1;
+        if (v >= 0 && (best < 0 || (high ? v > best : v < best))) best = v;
+    }
+
+    return best;
+}
+
+// Статистика Hashlife по дереву: население — в корне, рамка — спуском вдоль краёв узора, в координатах
+// исходного поля (за его пределами — отрицательные или большие). Рождений и смертей дерево не хранит
+void hashlife_stats(const hashlife *h, gen_stats *s) {
+    stats_reset(s);
+    s->births = s->deaths = -1;
+    s->population = h->root->population;
+    if (s->population) {
+        s->top = h->top + hl_edge(h->root, 0);
+        s->bottom = h->top + hl_edge(h->root, 1);
+        s->left = h->left + hl_edge(h->root, 2);
+        s->right = h->left + hl_edge(h->root, 3);
+    }
+}
+
+void free_tileset(tileset *t);
+
+// Создаём разбиение битового поля на плитки; на первом шаге считаются все плитки
+tileset *create_tileset(const bitfield *b) {
+    tileset *t = malloc(sizeof(tileset));
+
+    if (t) {
+        size_t count;
+        t->rows = (b->height + TILE_ROWS - 1) / TILE_ROWS;
+        t->cols = b->words;
+        count = (size_t)t->rows * t->cols;
+        t->changed = malloc(count * sizeof(int));
+        t->work = malloc(count * sizeof(int));
+        t->stamp = calloc(count, sizeof(unsigned));
+        t->pop = calloc(count, sizeof(unsigned short));
+        t->row_mask = calloc(count, sizeof(unsigned short));
+        t->col_mask = calloc(count, sizeof(uint64_t));
+        t->epoch = 0;
+        t->active = 0;
+        t->track = 0;
+        if (!t->changed || !t->work || !t->stamp || !t->pop || !t->row_mask || !t->col_mask) {
+            free_tileset(t);
+            t = NULL;
+        } else {
+            t->nchanged = (int)count;  // Все плитки считаем изменившимися
+            for (size_t i = 0; i < count; i++) t->changed[i] = (int)i;
+        }
+    }
+
+    return t;
+}
+
+// Освобождаем разбиение на плитки
+void free_tileset(tileset *t) {
+    if (t) {
+        free(t->changed);
+        free(t->work);
+        free(t->stamp);
+        free(t->pop);
+        free(t->row_mask);
+        free(t->col_mask);
+        free(t);
+    }
+}
+
+// Следующее поколение с пропуском спокойных плиток. Если ни плитка, ни её соседки не менялись
+// на прошлом шаге, её клетки не меняются и на этом, а в буфере next уже лежит то же состояние
+// (поколение назад плитка была такой же) — поэтому её не нужно ни считать, ни копировать.
+// Статистика st (если нужна) собирается из сводок плиток без обхода клеток спокойных плиток. Сводки
+// ведутся с первого такого шага: на нём пересчитываются все плитки, дальше — только пересчитанные
+void next_gen_tiles(tileset *t, const bitfield *curr, bitfield *next, gen_stats *st) {
+    int nwork = 0, nchanged = 0, n = curr->words;
+
+    if (st && !t->track) {  // Сводок ещё нет — считаем все плитки изменившимися
+        t->track = 1;
+        t->nchanged = t->rows * t->cols;
+        for (int i = 0; i < t->nchanged; i++) t->changed[i] = i;
+    }
+    t->epoch++;
+    for (int c = 0; c < t->nchanged; c++) {  // Соседи изменившихся плиток (с замыканием тора)
+        int ty = t->changed[c] / t->cols, tx = t->changed[c] % t->cols;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int id = (ty + dy + t->rows) % t->rows * t->cols + (tx + dx + t->cols) % t->cols;
+                if (t->stamp[id] != t->epoch) {
+                    t->stamp[id] = t->epoch;
+                    t->work[nwork++] = id;
+                }
+            }
+        }
+    }
+
+    for (int w = 0; w < nwork; w++) {  // Пересчитываем плитки и запоминаем, какие изменились
+        int ty = t->work[w] / t->cols, k = t->work[w] % t->cols, h = curr->height;
+        int to = (ty + 1) * TILE_ROWS < h ? (ty + 1) * TILE_ROWS : h;
+        uint64_t mask = k == n - 1 ? curr->tail : ~(uint64_t)0, diff = 0, cols = 0;
+        unsigned pop = 0, rows = 0;
+        for (int i = ty * TILE_ROWS; i < to; i++) {
+            const uint64_t *up = curr->bits + (size_t)((i - 1 + h) % h) * n;
+            const uint64_t *mid = curr->bits + (size_t)i * n;
+            const uint64_t *down = curr->bits + (size_t)((i + 1) % h) * n;
+            uint64_t word = bits_word(up, mid, down, k, n, curr->width) & mask;
+            next->bits[(size_t)i * n + k] = word;
+            diff |= word ^ mid[k];
+            if (t->track) {
+                pop += (unsigned)__builtin_popcountll(word);
+                rows |= (unsigned)(word != 0) << (i - ty * TILE_ROWS);
+                cols |= word;
+            }
+            if (st) {
+                st->births += __builtin_popcountll(word & ~mid[k]);
+                st->deaths += __builtin_popcountll(mid[k] & ~word);
+            }
+        }
+        if (diff) t->changed[nchanged++] = t->work[w];
+        if (t->track) {
+            t->pop[t->work[w]] = (unsigned short)pop;
+            t->row_mask[t->work[w]] = (unsigned short)rows;
+            t->col_mask[t->work[w]] = cols;
+        }
+    }
+    t->nchanged = nchanged;
+    t->active = nwork;
+
+    for (int id = 0; st && id < t->rows * t->cols; id++) {  // Население и рамка — по сводкам плиток
+        if (t->pop[id]) {
+            int64_t top = (int64_t)(id / t->cols) * TILE_ROWS, left = (int64_t)(id % t->cols) * 64;
+            int64_t first = left + __builtin_ctzll(t->col_mask[id]);
+            int64_t last = left + 63 - __builtin_clzll(t->col_mask[id]);
+            st->population += t->pop[id];
+            stats_extent(st, top + __builtin_ctz(t->row_mask[id]), first, last);
+            stats_extent(st, top + 31 - __builtin_clz(t->row_mask[id]), first, last);
+        }
+    }
+}
+
+// Корзина участка (cy, cx) в хеш-таблице
+static size_t chunk_hash(int64_t cy, int64_t cx) {
+    uint64_t h = (uint64_t)cy * 0x9E3779B97F4A7C15ull ^ (uint64_t)cx * 0xC2B2AE3D27D4EB4Full;
+    return (size_t)(h ^ h >> 29);
+}
+
+// Участок (cy, cx) или NULL, если его нет (там нет живых клеток)
+chunk *chunk_find(const chunkmap *m, int64_t cy, int64_t cx) {
+    size_t k = chunk_hash(cy, cx) & (m->buckets - 1);
+
+    while (m->table[k] && !(m->table[k]->cy == cy && m->table[k]->cx == cx)) k = (k + 1) & (m->buckets - 1);
+
+    return m->table[k];
+}
+
+// Заново раскладываем все участки списка по хеш-таблице
+static void chunk_index(chunkmap *m) {
+    memset(m->table, 0, m->buckets * sizeof(chunk *));
+    for (size_t i = 0; i < m->count; i++) {
+        size_t k = chunk_hash(m->list[i]->cy, m->list[i]->cx) & (m->buckets - 1);
+        while (m->table[k]) k = (k + 1) & (m->buckets - 1);
+        m->table[k] = m->list[i];
+    }
+}
+
+// Переходим на хеш-таблицу из buckets корзин
+static int chunk_rehash(chunkmap *m, size_t buckets) {
+    chunk **table = calloc(buckets, sizeof(chunk *));
+
+    if (table) {
+        free(m->table);
+        m->table = table;
+        m->buckets = buckets;
+        chunk_index(m);
+    }
+
+    return table != NULL;
+}
+
+// Участок (cy, cx); если его нет — создаём пустой. NULL — не хватило памяти
+chunk *chunk_add(chunkmap *m, int64_t cy, int64_t cx) {
+    chunk *c = chunk_find(m, cy, cx);
+
+    if (!c && (m->count + 1) * 2 > m->buckets && !chunk_rehash(m, m->buckets * 2)) return NULL;
+    if (!c && m->count == m->capacity) {
+        chunk **list = realloc(m->list, sizeof(chunk *) * m->capacity * 2);
+        if (!list) return NULL;
+        m->list = list;
+        m->capacity *= 2;
+    }
+    if (!c && (c = calloc(1, sizeof(chunk)))) {
+        size_t k = chunk_hash(cy, cx) & (m->buckets - 1);
+        c->cy = cy;
+        c->cx = cx;
+        while (m->table[k]) k = (k + 1) & (m->buckets - 1);
+        m->table[k] = c;
+        m->list[m->count++] = c;
+    }
+
+    return c;
+}
+
+void free_chunkmap(chunkmap *m);
+
+// Создаём пустую плоскость участков
+chunkmap *create_chunkmap(void) {
+    chunkmap *m = calloc(1, sizeof(chunkmap));
+
+    if (m) {
+        m->buckets = 64;
+        m->capacity = 32;
+        m->table = calloc(m->buckets, sizeof(chunk *));
+        m->list = malloc(sizeof(chunk *) * m->capacity);
+        if (!m->table || !m->list) {
+            free_chunkmap(m);
+            m = NULL;
+        }
+    }
+
+    return m;
+}
+
+// Освобождаем все участки и саму плоскость
+void free_chunkmap(chunkmap *m) {
+    if (m) {
+        for (size_t i = 0; i < m->count; i++) free(m->list[i]);
+        free(m->table);
+        free(m->list);
+        free(m);
+    }
+}
+
+// Кладём живые клетки поля f на плоскость: клетка (i, j) поля — клетка (i, j) плоскости
+int chunkmap_load(chunkmap *m, const field *f) {
+    int success = 1;
+
+    for (size_t i = 0; i < m->count; i++) free(m->list[i]);  // Прежнее содержимое плоскости
+    m->count = 0;
+    chunk_index(m);
+    for (int i = 0; i < f->height && success; i++) {
+        for (int j = 0; j < f->width && success; j++) {
+            if (!CELL(f, i, j)) continue;
+            chunk *c = chunk_add(m, i / CHUNK_SIDE, j / CHUNK_SIDE);
+            if (c) c->rows[m->cur][i % CHUNK_SIDE] |= (uint64_t)1 << (j % CHUNK_SIDE);
+            success = c != NULL;
+        }
+    }
+
+    return success;
+}
+
+// Следующее поколение участка c в rows[cur ^ 1]. Строка участка с соседними строками участков слева
+// и справа — это строка из трёх слов, и её средним словом занимается то же ядро bits_word, что и
+// у битового движка: переносы через края участка оно берёт из соседних слов. Отсутствующие соседи —
+// пустые. Возвращает OR новых строк (0 — участок опустел)
+static uint64_t chunk_next(const chunkmap *m, chunk *c, gen_stats *st) {
+    static const uint64_t none[CHUNK_SIDE];  // Строки отсутствующего соседа
+    const uint64_t *g[3][3];                 // Текущие строки участка и соседей: g[dy + 1][dx + 1]
+    uint64_t *out = c->rows[m->cur ^ 1], any = 0;
+
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            const chunk *n = dx || dy ? chunk_find(m, c->cy + dy, c->cx + dx) : c;
+            g[dy + 1][dx + 1] = n ? n->rows[m->cur] : none;
+        }
+    }
+    for (int r = 0; r < CHUNK_SIDE; r++) {
+        uint64_t up[3], mid[3], down[3];  // Строки r - 1, r, r + 1 шириной в три участка
+        for (int k = 0; k < 3; k++) {
+            up[k] = r > 0 ? g[1][k][r - 1] : g[0][k][CHUNK_SIDE - 1];
+            mid[k] = g[1][k][r];
+            down[k] = r < CHUNK_SIDE - 1 ? g[1][k][r + 1] : g[2][k][0];
+        }
+        out[r] = bits_word(up, mid, down, 1, 3, 3 * CHUNK_SIDE);
+        any |= out[r];
+        if (st && (out[r] | mid[1])) {  // Пустые строки участков (их большинство) ничего не меняют
+            st->population += (uint64_t)__builtin_popcountll(out[r]);
+            st->births += __builtin_popcountll(out[r] & ~mid[1]);
+            st->deaths += __builtin_popcountll(mid[1] & ~out[r]);
+            if (out[r]) {
+                int64_t left = c->cx * CHUNK_SIDE;
+                stats_extent(st, c->cy * CHUNK_SIDE + r, left + __builtin_ctzll(out[r]),
+                             left + 63 - __builtin_clzll(out[r]));
+            }
+        }
+    }
+
+    return any;
+}
+
+// Шаг плоскости участков: сначала участки, у края которых есть живые клетки, получают недостающих
+// соседей (там могут родиться клетки), затем считаются все участки, и опустевшие освобождаются.
+// Правила с B0 сюда не попадают, поэтому участок без живых соседей пустым и останется
+int chunkmap_step(chunkmap *m, gen_stats *st) {
+    int success = 1;
+    size_t live = m->count, kept = 0;
+
+    for (size_t i = 0; i < live && success; i++) {
+        const uint64_t *rows = m->list[i]->rows[m->cur];  // Участки не двигаются при росте списка
+        int64_t cy = m->list[i]->cy, cx = m->list[i]->cx;
+        uint64_t all = 0;
+        for (int r = 0; r < CHUNK_SIDE; r++) all |= rows[r];
+        for (int dy = -1; dy <= 1 && success; dy++) {
+            for (int dx = -1; dx <= 1 && success; dx++) {
+                // Соседу нужны только клетки на общем крае (у угловых соседей — одна клетка)
+                uint64_t edge = dy < 0 ? rows[0] : dy > 0 ? rows[CHUNK_SIDE - 1] : all;
+                uint64_t mask = dx < 0 ? 1 : dx > 0 ? (uint64_t)1 << 63 : ~(uint64_t)0;
+                if ((dx || dy) && (edge & mask)) success = chunk_add(m, cy + dy, cx + dx) != NULL;
+            }
+        }
+    }
+    for (size_t i = 0; i < m->count && success; i++) m->list[i]->empty = !chunk_next(m, m->list[i], st);
+
+    if (success) {
+        m->cur ^= 1;
+        for (size_t i = 0; i < m->count; i++) {  // Освобождаем опустевшие участки
+            if (m->list[i]->empty) {
+                free(m->list[i]);
+            } else {
+                m->list[kept++] = m->list[i];
+            }
+        }
+        if (kept != m->count) {  // Таблица перестраивается без удалённых (и сжимается, если опустела)
+            size_t buckets = m->buckets;
+            m->count = kept;
+            while (buckets > 64 && kept * 8 < buckets) buckets /= 2;
+            if (buckets == m->buckets || !chunk_rehash(m, buckets)) chunk_index(m);
+        }
+    }
+
+    return success;
+}
+
+// Выгружаем окно плоскости, совпадающее с исходным полем, в обычное поле (для отрисовки)
+void chunkmap_store(const chunkmap *m, field *f) {
+    memset(f->cells, 0, (size_t)f->height * f->stride);
+    for (size_t i = 0; i < m->count; i++) {
+        const chunk *c = m->list[i];
+        for (int r = 0; r < CHUNK_SIDE; r++) {
+            int64_t y = c->cy * CHUNK_SIDE + r;
+            uint64_t word = c->rows[m->cur][r];
+            for (; word && y >= 0 && y < f->height; word &= word - 1) {
+                int64_t x = c->cx * CHUNK_SIDE + __builtin_ctzll(word);
+                if (x >= 0 && x < f->width) CELL(f, y, x) = 1;
+            }
+        }
+    }
+}
+
+// Статистика плоскости без предыдущего поколения (рождения и смерти неизвестны)
+void chunkmap_stats(const chunkmap *m, gen_stats *s) {
+    stats_reset(s);
+    for (size_t i = 0; i < m->count; i++) {
+        const chunk *c = m->list[i];
+        for (int r = 0; r < CHUNK_SIDE; r++) {
+            uint64_t word = c->rows[m->cur][r];
+            if (word) {
+                s->population += (uint64_t)__builtin_popcountll(word);
+                stats_extent(s, c->cy * CHUNK_SIDE + r, c->cx * CHUNK_SIDE + __builtin_ctzll(word),
+                             c->cx * CHUNK_SIDE + 63 - __builtin_clzll(word));
+            }
+        }
+    }
+    s->births = s->deaths = -1;
+}
+
+// Байты полосы j поколения p, выровненные по страницам: начало — вниз, конец — тоже вниз, кроме
+// последней полосы. Страница на стыке полос достаётся следующей полосе, так что сброс и вытеснение
+// одной полосы не задевают строк, которые ещё считаются
+static size_t disk_range(const disk_board *d, int p, int j, unsigned char **addr) {
+    size_t row = (size_t)d->plane[p].words * sizeof(uint64_t);
+    unsigned char *base = (unsigned char *)d->plane[p].bits;
+    size_t from = (size_t)j * d->band * row / d->page * d->page;
+    size_t to = j + 1 < d->bands ? (size_t)(j + 1) * d->band * row / d->page * d->page
+                                 : ((size_t)d->plane[p].height * row + d->page - 1) / d->page * d->page;
+    *addr = base + from;
+    return to > from ? to - from : 0;
+}
+
+// Просим ОС заранее прочитать полосу j поколения p (чтение идёт в фоне, счёт не ждёт)
+static void disk_prefetch(const disk_board *d, int p, int j) {
+    unsigned char *addr;
+    size_t len = disk_range(d, p, j, &addr);
+    if (len) madvise(addr, len, MADV_WILLNEED);
+}
+
+// Выталкиваем полосу j поколения p из памяти процесса и из страничного кэша; с sync полоса сначала
+// записывается на диск (грязные страницы кэш не отдаёт)
+static int disk_evict(const disk_board *d, int p, int j, int sync) {
+    unsigned char *addr;
+    size_t len = disk_range(d, p, j, &addr);
+    int success = 1;
+
+    if (len) {
+        if (sync && msync(addr, len, MS_SYNC) != 0) success = 0;
+        madvise(addr, len, MADV_DONTNEED);
+        posix_fadvise(d->fd, (off_t)(addr - d->map), (off_t)len, POSIX_FADV_DONTNEED);
+    }
+    return success;
+}
+
+// Поток отложенной записи: полосы нового поколения сбрасываются по порядку, следом из памяти уходит
+// полоса прошлого поколения, которая больше не нужна ни одной строке
+void *disk_writer(void *arg) {
+    disk_board *d = arg;
+
+    pthread_mutex_lock(&d->lock);
+    for (;;) {
+        while (!d->stop && d->flushed == d->queued) pthread_cond_wait(&d->wake, &d->lock);
+        if (d->flushed == d->queued) break;  // Очередь пуста и пора выходить
+        int j = d->flushed, src = d->cur;    // cur меняется, только когда очередь пуста
+        pthread_mutex_unlock(&d->lock);
+
+        int success = disk_evict(d, 1 - src, j, 1);
+        if (j > 0) disk_evict(d, src, j - 1, 0);  // Полоса j + 1 читает не выше последней строки полосы j
+        if (j + 1 == d->bands) {  // Поколение готово: последняя полоса и первая (её читала последняя)
+            disk_evict(d, src, j, 0);
+            disk_evict(d, src, 0, 0);
+        }
+
+        pthread_mutex_lock(&d->lock);
+        if (!success) d->failed = 1;
+        d->flushed++;
+        pthread_cond_broadcast(&d->done);
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    return NULL;
+}
+
+// Заголовок доски: сигнатура, высота, ширина, слов в строке, текущее поколение в файле и его номер,
+// размер страницы (с него начинаются поколения) и маски правила
+static void disk_header(disk_board *d, uint64_t generation) {
+    memcpy(d->map, DISK_MAGIC, 8);
+    put_le(d->map + 8, (uint64_t)d->plane[0].height, 4);
+    put_le(d->map + 12, (uint64_t)d->plane[0].width, 4);
+    put_le(d->map + 16, (uint64_t)d->plane[0].words, 4);
+    put_le(d->map + 20, (uint64_t)d->cur, 4);
+    put_le(d->map + 24, generation, 8);
+    put_le(d->map + 32, d->page, 4);
+    put_le(d->map + 36, life_rule.birth, 2);
+    put_le(d->map + 38, life_rule.survive, 2);
+}
+
+// Файл fd уже доска? Возвращает 1 и заполняет head заголовком, если файл начинается с сигнатуры
+static int disk_existing(int fd, unsigned char *head) {
+    return pread(fd, head, DISK_HEADER, 0) == DISK_HEADER && memcmp(head, DISK_MAGIC, 8) == 0;
+}
+
+// Создаём доску height x width в файле path (NULL — безымянный временный файл в $TMPDIR).
+// Новый файл разрежен: нули не занимают места, пока полосы не записаны. Доску этого же размера
+// в path не стираем, а открываем как есть — счёт продолжится с её поколения (resumed); доску другого
+// размера и непустой файл, который доской не является, не трогаем вовсе
+disk_board *create_disk(int height, int width, const char *path) {
+    disk_board *d = calloc(1, sizeof(disk_board));
+    int success = d != NULL;
+    unsigned char head[DISK_HEADER];  // Заголовок прежней доски в path
+
+    if (success) {
+        d->fd = -1;
+        d->map = MAP_FAILED;
+        if (path) {
+            d->fd = open(path, O_RDWR | O_CREAT, 0644);
+            d->resumed = d->fd >= 0 && disk_existing(d->fd, head);
+        } else {
+            const char *dir = getenv("TMPDIR");
+            char name[4096];
+            snprintf(name, sizeof(name), "%s/golboardXXXXXX", dir && *dir ? dir : "/tmp");
+            d->fd = mkstemp(name);
+            if (d->fd >= 0) unlink(name);  // Временный файл исчезнет вместе с дескриптором
+        }
+        success = d->fd >= 0;
+    }
+    if (success) {
+        int words = (width + 63) / 64;
+        size_t bytes = (size_t)height * words * sizeof(uint64_t);
+        d->page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t plane = (bytes + d->page - 1) / d->page * d->page;  // Поколения начинаются со страницы
+        d->size = d->page + 2 * plane;
+        d->band = (int)(DISK_BAND / (words * sizeof(uint64_t)));
+        if (d->band < 1) d->band = 1;
+        if (d->band > height) d->band = height;
+        d->bands = (height + d->band - 1) / d->band;
+        if (d->resumed) {  // Прежняя доска должна совпасть с новой до байта
+            struct stat st;
+            success = get_le(head + 8, 4) == (uint64_t)height && get_le(head + 12, 4) == (uint64_t)width &&
+                      get_le(head + 16, 4) == (uint64_t)words && get_le(head + 20, 4) <= 1 &&
+                      get_le(head + 32, 4) == d->page && fstat(d->fd, &st) == 0 &&
+                      (size_t)st.st_size == d->size;
+            if (!success) {
+                fprintf(stderr, "Board file %s holds a %llux%llu board, not %dx%d\n", path,
+                        (unsigned long long)get_le(head + 12, 4), (unsigned long long)get_le(head + 8, 4),
+                        width, height);
+            }
+            d->cur = (int)get_le(head + 20, 4);
+            d->generation = get_le(head + 24, 8);
+        } else {  // Файл новый или пустой: disk_load рассчитывает на нули
+            struct stat st;
+            success = fstat(d->fd, &st) == 0;
+            if (success && st.st_size != 0) {
+                fprintf(stderr, "%s exists and is not a board file: refusing to overwrite it\n", path);
+                success = 0;
+            }
+            success = success && ftruncate(d->fd, (off_t)d->size) == 0;
+        }
+        if (success) d->map = mmap(NULL, d->size, PROT_READ | PROT_WRITE, MAP_SHARED, d->fd, 0);
+        success = success && d->map != MAP_FAILED;
+        for (int p = 0; success && p < 2; p++) {
+            d->plane[p].height = height;
+            d->plane[p].width = width;
+            d->plane[p].words = words;
+            d->plane[p].tail = (width % 64) ? (((uint64_t)1 << (width % 64)) - 1) : ~(uint64_t)0;
+            d->plane[p].bits = (uint64_t *)(d->map + d->page + p * plane);
+        }
+    }
+    if (success) {
+        if (!d->resumed) disk_header(d, 0);
+        pthread_mutex_init(&d->lock, NULL);
+        pthread_cond_init(&d->wake, NULL);
+        pthread_cond_init(&d->done, NULL);
+        success = pthread_create(&d->writer, NULL, disk_writer, d) == 0;
+        if (!success) {
+            pthread_mutex_destroy(&d->lock);
+            pthread_cond_destroy(&d->wake);
+            pthread_cond_destroy(&d->done);
+        }
+    }
+    if (!success && d) {
+        fprintf(stderr, "Cannot create board file: %s\n", path ? path : "(temporary)");
+        if (d->map != MAP_FAILED) munmap(d->map, d->size);
+        if (d->fd >= 0) close(d->fd);
+        free(d);
+        d = NULL;
+    }
+
+    return d;
+}
+
+// Останавливаем поток записи и закрываем файл (именованный файл остаётся с последним поколением)
+void free_disk(disk_board *d) {
+    if (d) {
+        pthread_mutex_lock(&d->lock);
+        d->stop = 1;
+        pthread_cond_signal(&d->wake);
+        pthread_mutex_unlock(&d->lock);
+        pthread_join(d->writer, NULL);
+        pthread_mutex_destroy(&d->lock);
+        pthread_cond_destroy(&d->wake);
+        pthread_cond_destroy(&d->done);
+        munmap(d->map, d->size);
+        close(d->fd);
+        free(d);
+    }
+}
+
+// Ставим узор f на доску со строки top и столбца left. Файл только что создан и состоит из нулей —
+// пишутся лишь живые клетки
+void disk_load(disk_board *d, const field *f) {
+    bitfield *b = &d->plane[d->cur];
+
+    for (int i = 0; i < f->height; i++) {
+        uint64_t *row = b->bits + (size_t)(d->top + i) * b->words;
+        for (int j = 0; j < f->width; j++) {
+            if (CELL(f, i, j)) row[(d->left + j) / 64] |= (uint64_t)1 << ((d->left + j) % 64);
+        }
+    }
+}
+
+// Шаг доски к поколению generation. Полосы считаются по порядку тем же ядром, что и у битового
+// движка; перед каждой ОС читает следующую полосу обоих поколений, а посчитанные уходят потоку записи.
+// Счёт обгоняет запись не больше чем на DISK_BEHIND полос — столько грязных полос и держит память
+int disk_step(disk_board *d, uint64_t generation, gen_stats *st) {
+    const bitfield *src = &d->plane[d->cur];
+    bitfield *dst = &d->plane[1 - d->cur];
+    int success;
+
+    disk_prefetch(d, d->cur, 0);
+    for (int j = 0; j < d->bands; j++) {
+        int from = j * d->band, to = from + d->band < src->height ? from + d->band : src->height;
+        if (j + 1 < d->bands) {
+            disk_prefetch(d, d->cur, j + 1);
+            disk_prefetch(d, 1 - d->cur, j + 1);  // Строки нового поколения ОС тоже сперва читает
+        }
+        next_gen_bits_rows(src, dst, from, to, st);
+        pthread_mutex_lock(&d->lock);
+        d->queued = j + 1;
+        pthread_cond_signal(&d->wake);
+        while (d->queued - d->flushed > DISK_BEHIND) pthread_cond_wait(&d->done, &d->lock);
+        pthread_mutex_unlock(&d->lock);
+    }
+    pthread_mutex_lock(&d->lock);  // Ждём последние полосы: следующий шаг читает новое поколение
+    while (d->flushed < d->queued) pthread_cond_wait(&d->done, &d->lock);
+    d->queued = d->flushed = 0;
+    success = !d->failed;
+    pthread_mutex_unlock(&d->lock);
+    d->cur = 1 - d->cur;
+    disk_header(d, generation);
+
+    return success;
+}
+
+// Пишем текущее поколение доски в формате 0/1 полосами: прочитанная полоса сразу уходит из памяти
+int disk_write(const disk_board *d, FILE *out) {
+    int success = 1;
+
+    for (int j = 0; j < d->bands && success; j++) {
+        bitfield part = d->plane[d->cur];  // Полоса как отдельное битовое поле
+        int from = j * d->band;
+        part.height = from + d->band < part.height ? d->band : part.height - from;
+        part.bits += (size_t)from * part.words;
+        if (j + 1 < d->bands) disk_prefetch(d, d->cur, j + 1);
+        success = write_bits(&part, out);
+        disk_evict(d, d->cur, j, 0);
+    }
+
+    return success;
+}
+
+// Статистика текущего поколения доски без предыдущего (рождения и смерти неизвестны)
+void disk_stats(const disk_board *d, gen_stats *s) {
+    const bitfield *b = &d->plane[d->cur];
+
+    stats_reset(s);
+    for (int i = 0; i < b->height; i++) {
+        const uint64_t *row = b->bits + (size_t)i * b->words;
+        stats_row_bits(s, row, row, b->words, i);
+    }
+    s->births = s->deaths = -1;
+}
+
+// Первая строка полосы index из threads; границы полос кратны 8 строкам,
+// чтобы соседние потоки не писали в одну линию кэша
+int band_row(int height, int index, int threads) {
+    int row = (int)((long long)height * index / threads) / 8 * 8;
+    return index == threads ? height : row;
+}
+
+// Считаем полосу строк index в зависимости от типа движка
+// Статистика полосы копится в локальной переменной и записывается один раз в конце
+void engine_step_band(struct engine *e, int index) {
+    int h = e->curr->height;
+    int from = band_row(h, index, e->threads), to = band_row(h, index + 1, e->threads);
+    gen_stats local, *st = e->stats_want ? &local : NULL;  // NULL — статистика на этом шаге не нужна
+
+    if (st) stats_reset(st);
+    if (e->type == ENGINE_BITS && e->block > 1) {  // Временной блок: block поколений за проход плиток
+        uint64_t *scratch = e->tblock + temporal_words(e->temporal) * index;  // Буферы плиток этого потока
+        temporal_rows(e->bcurr, e->bnext, from, to, e->block, scratch);
+    } else if (e->type == ENGINE_BITS) {  // Битовый движок считает целыми словами
+        next_gen_bits_rows(e->bcurr, e->bnext, from, to, st);
+    } else if (e->type == ENGINE_SIMD) {  // Векторный движок считает байтовыми дорожками
+        next_gen_simd_rows(e->curr, e->next, e->line + 3 * simd_line_len(e->curr) * index, from, to, st);
+    } else if (e->type == ENGINE_HALO) {  // Движок с рамкой читает соседей без проверок края
+        next_gen_halo_rows(e->gcurr, e->gnext, from, to, st);
+    } else {
+        next_gen_rows(e->curr, e->next, from, to, e->boundary, st);  // Вычисляем полосу следующего поколения
+    }
+    if (st) e->band[index] = local;
+}
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;  // Держится, пока пул настраивается
+
+// Цикл потока пула: ждём начала поколения, считаем свою полосу, отмечаемся на барьере конца
+void *engine_worker(void *arg) {
+    worker_arg *w = arg;
+    struct engine *e = w->e;
+
+    pthread_mutex_lock(&pool_lock);  // Ждём, пока главный поток создаст барьеры
+    pthread_mutex_unlock(&pool_lock);
+    for (;;) {
+        prof_mark mark;
+        pthread_barrier_wait(&e->start);  // Ждём, пока главный поток выдаст поколение
+        if (e->stop) break;               // Движок освобождается — выходим
+        prof_begin(&mark);
+        engine_step_band(e, w->index);
+        prof_share(&mark, PHASE_STEP);    // События полосы — в шаг, который меряет главный поток
+        pthread_barrier_wait(&e->done);   // Полоса готова
+    }
+    prof_release();
+
+    return NULL;
+}
+
+// Запускаем постоянный пул из threads - 1 потоков (главный поток считает полосу 0).
+// Барьеры создаются после запуска потоков под фактическое их число, поэтому потоки
+// сначала ждут на мьютексе, пока главный поток не закончит настройку пула
+int engine_start_pool(engine *e) {
+    int success = 1;
+
+    e->stop = 0;
+    if (e->threads > 1) {
+        e->workers = malloc(sizeof(pthread_t) * (e->threads - 1));
+        e->args = malloc(sizeof(worker_arg) * e->threads);
+        success = e->workers && e->args;
+        if (!success) e->threads = 1;
+    }
+    if (e->threads > 1) {
+        int started = 1;  // Сколько потоков работает, включая главный
+
+        pthread_mutex_lock(&pool_lock);
+        for (int i = 1; i < e->threads && started == i; i++) {
+            e->args[i].e = e;
+            e->args[i].index = i;
+            if (pthread_create(&e->workers[i - 1], NULL, engine_worker, &e->args[i]) == 0) started++;
+        }
+        if (started < e->threads) {  // Не все потоки создались — полосы делим между запущенными
+            fprintf(stderr, "Cannot start %d worker threads, using %d\n", e->threads, started);
+            e->threads = started;
+        }
+        pthread_barrier_init(&e->start, NULL, e->threads);
+        pthread_barrier_init(&e->done, NULL, e->threads);
+        pthread_mutex_unlock(&pool_lock);  // Пул готов — отпускаем потоки к барьеру начала поколения
+    }
+
+    return success;
+}
+
+// Создаём движок нужного типа с буферами двух поколений height x width и пулом из threads потоков
+int engine_create(engine *e, int type, int height, int width, int threads, int boundary, const char *disk) {
+    e->type = type;
+    e->boundary = boundary;
+    // Обычное поле нужно движкам для чтения и отрисовки; движку disk поле целиком в памяти не нужно,
+    // узор для него читается в поле своего размера (engine_stage)
+    e->curr = type != ENGINE_DISK ? create_field(height, width) : NULL;
+    e->next = type != ENGINE_DISK ? create_field(height, width) : NULL;
+    e->bcurr = e->bnext = NULL;
+    e->line = NULL;
+    e->hl = NULL;
+    e->tiles = NULL;
+    e->chunks = NULL;
+    e->disk = NULL;
+    e->gcurr = e->gnext = NULL;
+    // Hashlife и плитки считают в одном потоке: работы на шаге мало и она не делится на полосы.
+    // Доске на диске больше одного потока не поможет — её предел — скорость диска
+    e->threads = type == ENGINE_HASHLIFE || type == ENGINE_TILES || type == ENGINE_CHUNKS ||
+                 type == ENGINE_DISK ? 1 : threads;
+    e->workers = NULL;
+    e->args = NULL;
+    e->temporal = e->block = 1;
+    e->tblock = NULL;
+    e->stats_gen = UINT64_MAX;
+    e->stats_want = e->stats_last = 0;
+    e->stream = NULL;
+    e->band = calloc((size_t)e->threads, sizeof(gen_stats));
+
+    if (type == ENGINE_BITS || type == ENGINE_TILES) {
+        e->bcurr = create_bitfield(height, width);
+        e->bnext = create_bitfield(height, width);
+        if (type == ENGINE_TILES && e->bcurr) e->tiles = create_tileset(e->bcurr);
+    } else if (type == ENGINE_SIMD && e->curr) {
+        size_t size = 3 * simd_line_len(e->curr) * threads;  // По три расширенные строки на поток
+        if (!life_row) simd_init();  // Ядро обычно уже выбрал rule_init
+        e->line = aligned_alloc(CACHE_LINE, size);
+        if (e->line) memset(e->line, 0, size);  // Запас за краем строк — нули
+    } else if (type == ENGINE_HASHLIFE) {
+        e->hl = create_hashlife();
+    } else if (type == ENGINE_HALO) {
+        e->gcurr = create_field(height + 2, width + 2);  // Рамка в одну клетку с каждой стороны
+        e->gnext = create_field(height + 2, width + 2);
+    } else if (type == ENGINE_CHUNKS) {
+        e->chunks = create_chunkmap();
+    } else if (type == ENGINE_DISK) {
+        e->disk = create_disk(height, width, disk);
+    }
+
+    int success = ((e->curr && e->next) || type == ENGINE_DISK) && e->band &&
+                  (type != ENGINE_BITS || (e->bcurr && e->bnext)) &&
+                  (type != ENGINE_SIMD || e->line) && (type != ENGINE_HASHLIFE || e->hl) &&
+                  (type != ENGINE_TILES || (e->bcurr && e->bnext && e->tiles)) &&
+                  (type != ENGINE_HALO || (e->gcurr && e->gnext)) && (type != ENGINE_CHUNKS || e->chunks) &&
+                  (type != ENGINE_DISK || e->disk);
+    if (success) {
+        success = engine_start_pool(e);
+    } else {
+        e->threads = 1;  // Пул не запускался — освобождать в нём нечего
+    }
+
+    return success;
+}
+
+// Освобождаем все буферы движка и останавливаем пул
+void engine_free(engine *e) {
+    if (e->threads > 1 && e->workers) {
+        e->stop = 1;  // Будим потоки пула с флагом остановки и ждём их завершения
+        pthread_barrier_wait(&e->start);
+        for (int i = 1; i < e->threads; i++) pthread_join(e->workers[i - 1], NULL);
+        pthread_barrier_destroy(&e->start);
+        pthread_barrier_destroy(&e->done);
+    }
+    free(e->workers);
+    free(e->args);
+    free(e->tblock);
+    e->tblock = NULL;
+    free(e->band);
+    e->band = NULL;
+    free_field(e->curr);
+    free_field(e->next);
+    free_bitfield(e->bcurr);
+    free_bitfield(e->bnext);
+    free(e->line);
+    free_hashlife(e->hl);
+    free_tileset(e->tiles);
+    free_chunkmap(e->chunks);
+    free_disk(e->disk);
+    free_field(e->gcurr);
+    free_field(e->gnext);
+    e->gcurr = e->gnext = NULL;
+    e->hl = NULL;
+    e->tiles = NULL;
+    e->chunks = NULL;
+    e->disk = NULL;
+    e->curr = e->next = NULL;
+    e->bcurr = e->bnext = NULL;
+    e->line = NULL;
+    e->workers = NULL;
+    e->args = NULL;
+    e->threads = 1;
+}
+
+// Временные блоки по k поколений для битового движка; другим движкам они не нужны, и k остаётся 1
+int engine_temporal(engine *e, int k) {
+    if (e->type != ENGINE_BITS || k <= 1) return 1;
+    e->tblock = aligned_alloc(CACHE_LINE, temporal_words(k) * e->threads * sizeof(uint64_t));
+    if (e->tblock) e->temporal = k;
+    return e->tblock != NULL;
+}
+
+// Поле для чтения узора размером height x width. У движков с обычным полем оно уже есть; движок disk
+// получает поле размером с узор и при загрузке ставит его в центр доски (centre) или в левый верхний угол
+int engine_stage(engine *e, int height, int width, int centre) {
+    if (e->type == ENGINE_DISK) {
+        e->disk->top = centre ? (e->disk->plane[0].height - height) / 2 : 0;
+        e->disk->left = centre ? (e->disk->plane[0].width - width) / 2 : 0;
+    }
+    if (!e->curr) e->curr = create_field(height, width);
+    return e->curr != NULL;
+}
+
+// Переносим начальное состояние из e->curr во внутренний формат движка
+int engine_load(engine *e) {
+    int success = 1;
+    prof_mark mark;
+
+    prof_begin(&mark);
+    e->stats_gen = UINT64_MAX;  // Статистика прежнего поля больше не верна
+    if (e->type == ENGINE_BITS) {
+        pack_field(e->curr, e->bcurr);
+    } else if (e->type == ENGINE_TILES) {
+        pack_field(e->curr, e->bcurr);
+        pack_field(e->curr, e->bnext);  // Оба буфера согласованы, на первом шаге считаются все плитки
+        e->tiles->nchanged = e->tiles->rows * e->tiles->cols;
+        for (int i = 0; i < e->tiles->nchanged; i++) e->tiles->changed[i] = i;
+    } else if (e->type == ENGINE_HASHLIFE) {
+        success = hashlife_load(e->hl, e->curr);
+    } else if (e->type == ENGINE_HALO) {
+        halo_load(e->curr, e->gcurr);
+    } else if (e->type == ENGINE_CHUNKS) {
+        success = chunkmap_load(e->chunks, e->curr);
+    } else if (e->type == ENGINE_DISK) {
+        disk_load(e->disk, e->curr);
+        free_field(e->curr);  // Узор перенесён в файл, дальше поле живёт только там
+        e->curr = NULL;
+    }
+    prof_end(&mark, PHASE_READ);
+
+    return success;
+}
+
+// Один шаг симуляции выбранным движком. С пулом каждый поток считает свою полосу строк,
+// а поля меняются местами только после барьера, когда все полосы готовы. 0 — Hashlife или chunks
+// не хватило памяти (или узор ушёл с плоскости Hashlife)
+int engine_step(engine *e) {
+    if (e->type == ENGINE_HASHLIFE) {
+        return hashlife_advance(e->hl, 1);  // Hashlife умеет только целый шаг и полосы не использует
+    }
+    if (e->type == ENGINE_CHUNKS) {  // Участки считаются в одном потоке и сами хранят оба поколения
+        if (e->stats_want) stats_reset(&e->stats);
+        return chunkmap_step(e->chunks, e->stats_want ? &e->stats : NULL);
+    }
+    if (e->type == ENGINE_DISK) {  // Доска в файле считается полосами, ввод-вывод идёт фоном
+        if (e->stats_want) stats_reset(&e->stats);
+        return disk_step(e->disk, e->generation + 1, e->stats_want ? &e->stats : NULL);
+    }
+    if (e->type == ENGINE_HALO) halo_fill(e->gcurr, e->boundary);  // Рамка — до раздачи полос потокам
+    if (e->type == ENGINE_TILES) {  // Только плитки рядом с изменениями
+        if (e->stats_want) stats_reset(&e->stats);
+        next_gen_tiles(e->tiles, e->bcurr, e->bnext, e->stats_want ? &e->stats : NULL);
+    } else if (e->threads > 1) {
+        pthread_barrier_wait(&e->start);  // Раздаём поколение потокам пула
+        engine_step_band(e, 0);           // Главный поток считает первую полосу
+        pthread_barrier_wait(&e->done);   // Ждём все полосы
+    } else {
+        engine_step_band(e, 0);
+    }
+    if (e->stats_want && e->type != ENGINE_TILES) {  // Сводим статистику полос
+        stats_reset(&e->stats);
+        for (int i = 0; i < e->threads; i++) stats_merge(&e->stats, &e->band[i]);
+    }
+
+    if (e->type == ENGINE_BITS || e->type == ENGINE_TILES) {
+        bitfield *tmp = e->bcurr;  // Меняем битовые поля местами
+        e->bcurr = e->bnext;
+        e->bnext = tmp;
+    } else if (e->type == ENGINE_HALO) {
+        field *tmp = e->gcurr;  // Меняем местами поля с рамкой
+        e->gcurr = e->gnext;
+        e->gnext = tmp;
+    } else {
+        field *tmp = e->curr;  // Меняем поля местами для переключения поколений
+        e->curr = e->next;
+        e->next = tmp;
+    }
+
+    return 1;
+}
+
+const gen_stats *engine_stats(engine *e);
+field *engine_view(engine *e);
+const bitfield *engine_bits(engine *e, bitfield *scratch);
+
+// Продвигаем поле на gens поколений: Hashlife прыгает сразу, остальные движки шагают по одному.
+// С потоком статистики Hashlife прыгает отрезками до каждого кратного stream->every поколения,
+// а шагающие движки считают статистику только на шагах к таким поколениям (и на последнем шаге,
+// если её просит stats_last). Битовый движок с --temporal-k проходит временными блоками поколения,
+// для которых не нужны ни статистика, ни запись. Кадры экспорта ложатся на концы отрезков и блоков
+int engine_advance(engine *e, uint64_t gens) {
+    int success = 1;
+    uint64_t every = e->stream ? e->stream->every : 0;
+    uint64_t shot = e->export ? e->export->every : 0;  // Период кадров экспорта
+
+    while (success && gens) {
+        prof_mark mark;
+        uint64_t span = 1;
+        uint64_t block = e->temporal > 1 && !e->record ? gens - (e->stats_last ? 1 : 0) : 0;
+        if (every && every - e->generation % every - 1 < block) block = every - e->generation % every - 1;
+        if (shot && shot - e->generation % shot < block) block = shot - e->generation % shot;
+        if (block > (uint64_t)e->temporal) block = (uint64_t)e->temporal;
+        prof_begin(&mark);
+        if (e->type == ENGINE_HASHLIFE) {
+            span = every && every - e->generation % every < gens ? every - e->generation % every : gens;
+            if (shot && shot - e->generation % shot < span) span = shot - e->generation % shot;
+            if (e->record) span = 1;  // Записи нужно каждое поколение
+            success = hashlife_advance(e->hl, span);
+        } else if (block > 1) {
+            span = block;
+            e->block = (int)block;
+            e->stats_want = 0;
+            success = engine_step(e);
+            e->block = 1;
+        } else {
+            e->stats_want = (e->stats_last && gens == 1) || (every && (e->generation + 1) % every == 0);
+            success = engine_step(e);
+            if (success && e->stats_want) e->stats_gen = e->generation + 1;
+        }
+        prof_end(&mark, PHASE_STEP);
+        if (success) {
+            e->generation += span;
+            gens -= span;
+            int sample = every && e->generation % every == 0;  // Поколение потока статистики
+            int frame = shot && e->generation % shot == 0;     // Поколение кадра экспорта
+            if (sample || frame || e->record) {  // Вывод шага — отдельная фаза профиля
+                prof_begin(&mark);
+                if (sample) stats_write(e->stream, e->generation, engine_stats(e));
+                if (e->record) record_frame(e->record, engine_bits(e, e->record->pack), e->generation);
+                if (frame) export_frame(e->export, engine_bits(e, e->export->pack), e->generation);
+                prof_end(&mark, PHASE_WRITE);
+            }
+        }
+    }
+
+    return success;
+}
+
+// Текущее поколение в виде обычного поля (для отрисовки). У движка disk такого поля нет: он работает
+// только в пакетном режиме, итог пишет headless_output прямо из файла
+field *engine_view(engine *e) {
+    if (e->type == ENGINE_BITS || e->type == ENGINE_TILES) {
+        unpack_field(e->bcurr, e->curr);  // Распаковываем поколение для отрисовки
+    } else if (e->type == ENGINE_HASHLIFE) {
+        hashlife_store(e->hl, e->curr);  // Окно плоскости на месте исходного поля
+    } else if (e->type == ENGINE_HALO) {
+        halo_store(e->gcurr, e->curr);  // Внутренность поля без рамки
+    } else if (e->type == ENGINE_CHUNKS) {
+        chunkmap_store(e->chunks, e->curr);  // Окно плоскости на месте исходного поля
+    }
+    return e->curr;
+}
+
+// Текущее поколение битами: у битовых движков — их собственное поле, у остальных — вид, упакованный
+// в scratch
+const bitfield *engine_bits(engine *e, bitfield *scratch) {
+    if (e->type == ENGINE_BITS || e->type == ENGINE_TILES) return e->bcurr;
+    if (e->type == ENGINE_DISK) return &e->disk->plane[e->disk->cur];
+    pack_field(engine_view(e), scratch);
+    return scratch;
+}
+
+// Статистика текущего поколения. Обычно её уже посчитал шаг; иначе (начальное поле, Hashlife)
+// она считается здесь — по полю или по дереву
+const gen_stats *engine_stats(engine *e) {
+    if (e->stats_gen != e->generation) {
+        if (e->type == ENGINE_HASHLIFE) {
+            hashlife_stats(e->hl, &e->stats);
+        } else if (e->type == ENGINE_CHUNKS) {
+            chunkmap_stats(e->chunks, &e->stats);
+        } else if (e->type == ENGINE_DISK) {
+            disk_stats(e->disk, &e->stats);
+        } else {
+            stats_field(&e->stats, engine_view(e));
+        }
+        e->stats_gen = e->generation;
+    }
+    return &e->stats;
+}
+
+// Перемешивание 64-битного слова в хеш поколения
+static inline uint64_t hash_word(uint64_t h, uint64_t w) {
+    h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+    return h ^ h >> 32;
+}
+
+// 64-битный хеш текущего поколения; *empty = 1, если живых клеток нет. Битовые движки хешируют
+// слова напрямую, chunks — всю плоскость, остальные — байты клеток по восемь (хвосты строк за width
+// не участвуют)
+uint64_t engine_hash(engine *e, int *empty) {
+    uint64_t h = 0x243F6A8885A308D3ull, any = 0;
+
+    if (e->type == ENGINE_BITS || e->type == ENGINE_TILES || e->type == ENGINE_DISK) {
+        const bitfield *b = e->type == ENGINE_DISK ? &e->disk->plane[e->disk->cur] : e->bcurr;
+        for (size_t k = 0; k < (size_t)b->height * b->words; k++) {
+            h = hash_word(h, b->bits[k]);
+            any |= b->bits[k];
+        }
+    } else if (e->type == ENGINE_CHUNKS) {  // Порядок участков в списке случаен — складываем их хеши
+        const chunkmap *m = e->chunks;
+        for (size_t i = 0; i < m->count; i++) {
+            const chunk *c = m->list[i];
+            uint64_t ch = hash_word(hash_word(0x13198A2E03707344ull, (uint64_t)c->cy), (uint64_t)c->cx);
+            for (int r = 0; r < CHUNK_SIDE; r++) ch = hash_word(ch, c->rows[m->cur][r]);
+            h += ch;
+        }
+        any = m->count;  // Пустые участки освобождаются на том же шаге
+    } else {
+        const field *f = e->type == ENGINE_HALO ? e->gcurr : engine_view(e);
+        int off = e->type == ENGINE_HALO;  // Поле с рамкой хешируем на месте, без копии внутренности
+        int height = f->height - 2 * off, width = f->width - 2 * off;
+        for (int i = 0; i < height; i++) {
+            const unsigned char *row = f->cells + (size_t)(i + off) * f->stride + off;
+            int j = 0;
+            for (; j + 8 <= width; j += 8) {
+                uint64_t w;
+                memcpy(&w, row + j, 8);
+                h = hash_word(h, w);
+                any |= w;
+            }
+            uint64_t w = 0;  // Хвост строки короче восьми клеток
+            for (; j < width; j++) w = w << 8 | row[j];
+            h = hash_word(h, w);
+            any |= w;
+        }
+    }
+    *empty = !any;
+
+    return h;
+}
+
+// Учитываем хеш поколения gen (поколения подаются подряд). Возвращает найденный период или 0.
+// Совпадение 64-битных хешей принимаем за совпадение поколений. С B0 пустое поле на следующем шаге
+// оживает, поэтому его хеш — обычное состояние, а не вымирание
+uint64_t cycle_check(cycle_finder *c, uint64_t hash, int empty, uint64_t gen) {
+    if (c->period) return c->period;  // Цикл уже найден
+
+    if (empty && !life_rule.born[0]) {  // Вымершее поле — натюрморт с периодом 1
+        c->period = 1;
+        c->empty = 1;
+    }
+    for (uint64_t p = 1; !c->period && p < CYCLE_HISTORY && p <= c->seen; p++) {
+        if (c->ring[(gen - p) % CYCLE_HISTORY] == hash) c->period = p;
+    }
+    if (!c->period && c->seen && c->anchor == hash) c->period = gen - c->anchor_gen;
+    if (!c->period && (c->seen & (c->seen + 1)) == 0) {  // Переставляем якорь
+        c->anchor = hash;
+        c->anchor_gen = gen;
+    }
+    c->ring[gen % CYCLE_HISTORY] = hash;
+    c->seen++;
+    if (c->period) c->found = gen;
+
+    return c->period;
+}
+
+// Разбор аргументов командной строки:
+// [--engine ref|bits|simd|hashlife|tiles|halo|chunks|disk] [--disk file] [--boundary torus|dead|reflect]
+// [--size WxH] [--threads N] [--jump K] [--rule Bx/Sy]
+// [--generations N [--output file]] [--checkpoint file [--checkpoint-every N]]
+// [--stats file [--stats-every N]] [--record file [--keyframe-every N]] [--seek N]
+// [--export file.ppm|png|gif [--export-every N] [--scale N|1/N] [--export-threads N]]
+// [--ranks N] [--temporal-k K] [--profile file] <input_file>
+// Входной файл может быть и контрольной точкой или записью — счёт тогда продолжается с её поколения
+// --bench [--engine E] [--threads N] [--temporal-k K] [--rule Bx/Sy] [--profile file] [patterns_dir]
+// --soup N [--seed S] [--threads N] [--rule Bx/Sy] [--output file] [--profile file]
+int parse_args(int argc, const char *argv[], options *opt) {
+    int success = 1;
+
+    opt->input = NULL;
+    opt->engine = ENGINE_REF;
+    opt->height = 0;
+    opt->width = 0;
+    opt->threads = 1;
+    opt->jump = 0;
+    opt->generations = -1;
+    opt->output = NULL;
+    opt->engine_given = 0;
+    opt->threads_given = 0;
+    opt->bench = 0;
+    opt->boundary = BOUNDARY_TORUS;
+    opt->rule = life_rule;
+    opt->rule_given = 0;
+    opt->checkpoint = NULL;
+    opt->checkpoint_every = 0;
+    opt->stats = NULL;
+    opt->stats_every = 0;
+    opt->record = NULL;
+    opt->keyframe_every = 0;
+    opt->seek = -1;
+    opt->ranks = 0;
+    opt->soup = 0;
+    opt->seed = 1;
+    opt->disk = NULL;
+    opt->temporal_k = 1;
+    opt->profile = NULL;
+    opt->export = NULL;
+    opt->export_format = EXPORT_PPM;
+    opt->export_every = 0;
+    opt->export_scale = 1;
+    opt->export_shrink = 1;
+    opt->export_threads = 0;
+
+    for (int i = 1; i < argc && success; i++) {
+        if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            i++;
+            opt->engine_given = 1;
+            if (strcmp(argv[i], "ref") == 0) {
+                opt->engine = ENGINE_REF;  // Эталонный движок: подсчёт соседей для каждой клетки
+            } else if (strcmp(argv[i], "bits") == 0) {
+                opt->engine = ENGINE_BITS;  // Битовый движок, 64 клетки на слово
+            } else if (strcmp(argv[i], "simd") == 0) {
+                opt->engine = ENGINE_SIMD;  // Векторный движок, AVX2/SSE2/скаляр по возможностям процессора
+            } else if (strcmp(argv[i], "hashlife") == 0) {
+                opt->engine = ENGINE_HASHLIFE;  // Hashlife на бесконечной плоскости, прыжки на 2^k поколений
+            } else if (strcmp(argv[i], "tiles") == 0) {
+                opt->engine = ENGINE_TILES;  // Битовый движок, пересчитывающий только активные плитки
+            } else if (strcmp(argv[i], "halo") == 0) {
+                opt->engine = ENGINE_HALO;  // Поле с рамкой призрачных клеток, без делений в цикле
+            } else if (strcmp(argv[i], "chunks") == 0) {
+                opt->engine = ENGINE_CHUNKS;  // Бесконечная плоскость из участков 64x64 в хеш-таблице
+            } else if (strcmp(argv[i], "disk") == 0) {
+                opt->engine = ENGINE_DISK;  // Битовое поле в файле, отображённом в память, — больше памяти
+            } else {
+                fprintf(stderr, "Unknown engine: %s\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            char tail;  // Лишние символы после размеров
+            i++;
+            if (sscanf(argv[i], "%dx%d%c", &opt->width, &opt->height, &tail) != 2 || opt->width <= 0 ||
+                opt->height <= 0 || opt->width > MAX_SIDE || opt->height > MAX_SIDE) {
+                fprintf(stderr, "Invalid board size: %s (expected WxH, 1..%d)\n", argv[i], MAX_SIDE);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            opt->threads_given = 1;
+            if (sscanf(argv[i], "%d%c", &opt->threads, &tail) != 1 || opt->threads < 1 ||
+                opt->threads > MAX_THREADS) {
+                fprintf(stderr, "Invalid thread count: %s (expected 1..%d)\n", argv[i], MAX_THREADS);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--jump") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%d%c", &opt->jump, &tail) != 1 || opt->jump < 0 || opt->jump > 62) {
+                fprintf(stderr, "Invalid jump: %s (expected 0..62)\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--generations") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%lld%c", &opt->generations, &tail) != 1 || opt->generations < 0) {
+                fprintf(stderr, "Invalid generation count: %s\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            opt->output = argv[++i];
+        } else if (strcmp(argv[i], "--rule") == 0 && i + 1 < argc) {
+            i++;
+            opt->rule_given = 1;
+            if (!parse_rule(argv[i], &opt->rule)) {
+                fprintf(stderr, "Invalid rule: %s (expected B<digits>/S<digits>, e.g. B36/S23)\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--boundary") == 0 && i + 1 < argc) {
+            i++;
+            opt->boundary = BOUNDARY_COUNT;
+            for (int b = 0; b < BOUNDARY_COUNT; b++) {
+                if (strcmp(argv[i], boundary_names[b]) == 0) opt->boundary = b;
+            }
+            if (opt->boundary == BOUNDARY_COUNT) {
+                fprintf(stderr, "Unknown boundary: %s (expected torus, dead or reflect)\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            opt->checkpoint = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%lld%c", &opt->checkpoint_every, &tail) != 1 || opt->checkpoint_every < 1) {
+                fprintf(stderr, "Invalid checkpoint period: %s\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            opt->stats = argv[++i];
+        } else if (strcmp(argv[i], "--stats-every") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%lld%c", &opt->stats_every, &tail) != 1 || opt->stats_every < 1) {
+                fprintf(stderr, "Invalid statistics interval: %s\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            opt->record = argv[++i];
+        } else if (strcmp(argv[i], "--keyframe-every") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%lld%c", &opt->keyframe_every, &tail) != 1 || opt->keyframe_every < 1) {
+                fprintf(stderr, "Invalid keyframe interval: %s\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%lld%c", &opt->seek, &tail) != 1 || opt->seek < 0) {
+                fprintf(stderr, "Invalid generation to seek: %s\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--ranks") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%d%c", &opt->ranks, &tail) != 1 || opt->ranks < 1 ||
+                opt->ranks > MAX_RANKS) {
+                fprintf(stderr, "Invalid rank count: %s (expected 1..%d)\n", argv[i], MAX_RANKS);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--soup") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%lld%c", &opt->soup, &tail) != 1 || opt->soup < 1) {
+                fprintf(stderr, "Invalid soup count: %s\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            char tail;
+            unsigned long long seed = 0;
+            i++;
+            if (sscanf(argv[i], "%llu%c", &seed, &tail) != 1 || argv[i][0] == '-') {
+                fprintf(stderr, "Invalid seed: %s\n", argv[i]);
+                success = 0;
+            }
+            opt->seed = seed;
+        } else if (strcmp(argv[i], "--temporal-k") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%d%c", &opt->temporal_k, &tail) != 1 || opt->temporal_k < 1 ||
+                opt->temporal_k > TEMPORAL_MAX) {
+                fprintf(stderr, "Invalid temporal block: %s (expected 1..%d)\n", argv[i], TEMPORAL_MAX);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--disk") == 0 && i + 1 < argc) {
+            opt->disk = argv[++i];
+        } else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+            const char *ext;
+            opt->export = argv[++i];
+            ext = strrchr(opt->export, '.');
+            if (ext && strchr(ext, '/')) ext = NULL;  // Точка в имени каталога — не расширение
+            if (ext && strcmp(ext, ".ppm") == 0) {
+                opt->export_format = EXPORT_PPM;
+            } else if (ext && strcmp(ext, ".png") == 0) {
+                opt->export_format = EXPORT_PNG;
+            } else if (ext && strcmp(ext, ".gif") == 0) {
+                opt->export_format = EXPORT_GIF;
+            } else {
+                fprintf(stderr, "Unknown export format: %s (expected .ppm, .png or .gif)\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--export-every") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%lld%c", &opt->export_every, &tail) != 1 || opt->export_every < 1) {
+                fprintf(stderr, "Invalid export interval: %s\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "1/%d%c", &opt->export_shrink, &tail) == 1 && opt->export_shrink >= 1) {
+                opt->export_scale = 1;
+            } else if (sscanf(argv[i], "%d%c", &opt->export_scale, &tail) == 1 && opt->export_scale >= 1) {
+                opt->export_shrink = 1;
+            } else {
+                fprintf(stderr, "Invalid export scale: %s (expected N or 1/N)\n", argv[i]);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--export-threads") == 0 && i + 1 < argc) {
+            char tail;
+            i++;
+            if (sscanf(argv[i], "%d%c", &opt->export_threads, &tail) != 1 || opt->export_threads < 1 ||
+                opt->export_threads > EXPORT_WORKERS) {
+                fprintf(stderr, "Invalid export thread count: %s (expected 1..%d)\n", argv[i],
+                        EXPORT_WORKERS);
+                success = 0;
+            }
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            opt->profile = argv[++i];
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            opt->bench = 1;
+        } else if (argv[i][0] != '-' && !opt->input) {
+            opt->input = argv[i];  // Первый аргумент без дефиса — файл с полем
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+            success = 0;
+        }
+    }
+
+    if (success && opt->bench && !opt->input) opt->input = "patterns";  // Каталог шаблонов по умолчанию
+    if (success && !opt->input && !opt->soup) success = 0;  // Файл с полем обязателен (кроме поиска)
+    if (success && opt->output && opt->generations < 0 && !opt->soup) {
+        fprintf(stderr, "--output requires --generations\n");
+        success = 0;
+    }
+    if (success && opt->boundary != BOUNDARY_TORUS && opt->engine != ENGINE_REF &&
+        opt->engine != ENGINE_HALO) {
+        fprintf(stderr, "--boundary %s is supported only by the ref and halo engines\n",
+                boundary_names[opt->boundary]);
+        success = 0;
+    }
+    if (success && opt->checkpoint_every && !opt->checkpoint) {
+        fprintf(stderr, "--checkpoint-every requires --checkpoint\n");
+        success = 0;
+    }
+    if (success && opt->stats_every && !opt->stats) {
+        fprintf(stderr, "--stats-every requires --stats\n");
+        success = 0;
+    }
+    if (success && opt->ranks && (opt->generations < 0 || opt->checkpoint || opt->stats || opt->record ||
+                                  opt->threads > 1 || opt->boundary != BOUNDARY_TORUS ||
+                                  (opt->engine_given && opt->engine != ENGINE_BITS))) {
+        fprintf(stderr, "--ranks runs the bits kernel on a torus in batch mode (--generations) and cannot "
+                "be combined with --threads, --checkpoint, --stats or --record\n");
+        success = 0;
+    }
+    if (success && opt->ranks) opt->engine = ENGINE_BITS;  // Каждый ранг считает свою полосу битами
+    if (success && opt->temporal_k > 1 && !opt->bench &&
+        (opt->ranks || (opt->engine_given && opt->engine != ENGINE_BITS))) {
+        fprintf(stderr, "--temporal-k runs the bits engine and cannot be combined with --ranks or other "
+                "engines\n");
+        success = 0;
+    }
+    if (success && opt->temporal_k > 1 && !opt->bench) opt->engine = ENGINE_BITS;  // Блоки — у битового
+    if (success && opt->soup && (opt->bench || opt->generations >= 0 || opt->ranks ||
+                                 (opt->engine_given && opt->engine != ENGINE_CHUNKS))) {
+        fprintf(stderr, "--soup evolves soups on the chunks plane and cannot be combined with --bench, "
+                "--generations or --ranks\n");
+        success = 0;
+    }
+    if (success && opt->disk && opt->engine != ENGINE_DISK) {
+        fprintf(stderr, "--disk requires --engine disk\n");
+        success = 0;
+    }
+    if (success && opt->engine == ENGINE_DISK && !opt->bench && (opt->generations < 0 || opt->checkpoint)) {
+        fprintf(stderr, "The disk engine runs in batch mode (--generations) and keeps its state in the board "
+                "file instead of checkpoints: pass the board file as the input to continue a run\n");
+        success = 0;
+    }
+    // Окно плоскости Hashlife и участков не держит клеток за его краем: точка из окна продолжила бы
+    // уже другую эволюцию, а рамка всех живых клеток может расти без предела
+    if (success && opt->checkpoint && (opt->engine == ENGINE_HASHLIFE || opt->engine == ENGINE_CHUNKS)) {
+        fprintf(stderr, "The hashlife and chunks engines run on an unbounded plane and cannot write "
+                "checkpoints of the board window\n");
+        success = 0;
+    }
+    if (success && opt->keyframe_every && !opt->record) {
+        fprintf(stderr, "--keyframe-every requires --record\n");
+        success = 0;
+    }
+    if (success && !opt->export && (opt->export_every || opt->export_threads || opt->export_scale > 1 ||
+                                    opt->export_shrink > 1)) {
+        fprintf(stderr, "--export-every, --export-threads and --scale require --export\n");
+        success = 0;
+    }
+    if (success && opt->export && (opt->bench || opt->soup || opt->ranks || opt->engine == ENGINE_DISK)) {
+        fprintf(stderr, "--export writes frames of a single board and cannot be combined with --bench, "
+                "--soup, --ranks or the disk engine\n");
+        success = 0;
+    }
+
+    return success;
+}
+
+// Держим окно в пределах поля: при масштабе zoom на экране помещается rows * zoom строк поля
+void view_clamp(view *v, const field *f, int rows, int cols) {
+    int max_top = f->height - rows * v->zoom, max_left = f->width - cols * v->zoom;
+
+    if (v->top > max_top) v->top = max_top;
+    if (v->left > max_left) v->left = max_left;
+    if (v->top < 0) v->top = 0;
+    if (v->left < 0) v->left = 0;
+}
+
+// Клавиши окна: стрелки сдвигают его на четверть экрана, '+' и '-' меняют масштаб вокруг центра.
+// Возвращает 0, если клавиша не относится к окну
+int view_key(view *v, const field *f, int ch) {
+    int rows = LINES - 2 > 1 ? LINES - 2 : 1, cols = COLS > 1 ? COLS : 1;
+    int handled = 1;
+
+    if (ch == KEY_UP || ch == KEY_DOWN) {
+        int step = (rows / 4 > 0 ? rows / 4 : 1) * v->zoom;
+        v->top += ch == KEY_UP ? -step : step;
+    } else if (ch == KEY_LEFT || ch == KEY_RIGHT) {
+        int step = (cols / 4 > 0 ? cols / 4 : 1) * v->zoom;
+        v->left += ch == KEY_LEFT ? -step : step;
+    } else if (ch == '+' || ch == '=' || ch == '-' || ch == '_') {
+        int zoom = v->zoom;
+        if (ch == '+' || ch == '=') {
+            if (zoom > 1) zoom /= 2;  // Приближаем
+        } else if ((long long)rows * zoom < f->height || (long long)cols * zoom < f->width) {
+            zoom *= 2;  // Отдаляем, пока поле целиком не поместится на экран
+        }
+        v->top += rows * (v->zoom - zoom) / 2;  // Центр окна остаётся на месте
+        v->left += cols * (v->zoom - zoom) / 2;
+        v->zoom = zoom;
+    } else {
+        handled = 0;
+    }
+    view_clamp(v, f, rows, cols);
+
+    return handled;
+}
+
+// Символ экрана для квадрата zoom x zoom клеток с углом (i, j): 'O', если в нём есть живая клетка
+static char view_cell(const field *f, int i, int j, int zoom) {
+    int h = f->height - i < zoom ? f->height - i : zoom;
+    int w = f->width - j < zoom ? f->width - j : zoom;
+
+    for (int y = 0; y < h; y++) {
+        const unsigned char *row = f->cells + (size_t)(i + y) * f->stride + j;
+        for (int x = 0; x < w; x++) {
+            if (row[x]) return 'O';
+        }
+    }
+
+    return '.';
+}
+
+// Отрисовка игрового поля и информационной панели без clear(): строим каждую строку кадра,
+// сравниваем с уже выведенной и пишем одним вызовом только отрезок от первого до последнего изменения.
+// Две нижние строки — под панель, поле больше терминала смотрится через окно view
+void draw(view *v, const field *f, const gen_stats *st, uint64_t rate, int ch, const char *info) {
+    int rows = LINES - 2 > 0 ? LINES - 2 : 0;  // Строки экрана под поле
+    int cols = COLS;                           // Столбцы экрана
+    char pop[112];  // Население, рождения и смерти последнего шага, рамка живых клеток
+    int len = snprintf(pop, sizeof(pop), "Pop %llu", (unsigned long long)st->population);
+    prof_mark mark;
+
+    prof_begin(&mark);
+
+    if (rows != v->rows || cols != v->cols || !v->prev) {  // Первый кадр или терминал изменил размер
+        free(v->prev);
+        v->prev = calloc((size_t)(rows + 1) * cols + 1, 1);  // Кадр и буфер строки одним блоком
+        v->line = v->prev ? v->prev + (size_t)rows * cols : NULL;
+        v->rows = rows;
+        v->cols = cols;
+        erase();  // Старое содержимое экрана больше не совпадает с prev
+    }
+    view_clamp(v, f, rows, cols);
+
+    for (int i = 0; i < rows && v->prev; i++) {  // Строим кадр построчно
+        char *prev = v->prev + (size_t)i * cols;  // Эта строка на экране сейчас
+        int y = v->top + i * v->zoom;             // Строка поля для строки экрана
+        int first = -1, last = -1;                // Отрезок изменившихся символов
+
+        for (int j = 0; j < cols; j++) {
+            int x = v->left + j * v->zoom;
+            v->line[j] = y < f->height && x < f->width ? view_cell(f, y, x, v->zoom) : ' ';
+            if (v->line[j] != prev[j]) {
+                if (first < 0) first = j;
+                last = j;
+            }
+        }
+        if (first >= 0) {
+            mvaddnstr(i, first, v->line + first, last - first + 1);  // Один вызов на строку
+            memcpy(prev + first, v->line + first, (size_t)(last - first + 1));
+        }
+    }
+
+    if (st->births >= 0) {  // Hashlife рождений и смертей не знает
+        len += snprintf(pop + len, sizeof(pop) - len, " +%lld -%lld", (long long)st->births,
+                        (long long)st->deaths);
+    }
+    if (st->population) {
+        snprintf(pop + len, sizeof(pop) - len, " in %lldx%lld at %lld,%lld",
+                 (long long)(st->right - st->left + 1), (long long)(st->bottom - st->top + 1),
+                 (long long)st->left, (long long)st->top);
+    }
+
+    // Выводим снизу строку с целью скорости, статистикой поколения, окном и подсказкой по управлению
+    mvprintw(rows, 0, "Target: %llu gens/s | %s | View %d,%d 1:%d | A/Z - slower/faster, arrows - pan, "
+             "+/- - zoom, SPACE - exit", (unsigned long long)rate, pop, v->left, v->top, v->zoom);
+    clrtoeol();
+
+    // Выводим код и символ последней нажатой клавиши (если это печатный символ) и состояние симуляции
+    mvprintw(rows + 1, 0, "Last key: code = %3d, char = '%c' | %s", ch, (ch >= 32 && ch <= 126) ? ch : ' ',
+             info);
+    clrtoeol();
+
+    refresh();  // Обновляем экран, чтобы все изменения стали видны
+    prof_end(&mark, PHASE_DRAW);
+}
+
+// Текущее время в секундах по монотонным часам
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Пиковый объём резидентной памяти процесса в КБ с последнего сброса bench_reset_peak
+long bench_peak_rss(void) {
+    long peak = -1;
+    FILE *status = fopen("/proc/self/status", "r");
+    char line[256];
+
+    while (status && fgets(line, sizeof(line), status)) {
+        if (strncmp(line, "VmHWM:", 6) == 0) sscanf(line + 6, "%ld", &peak);
+    }
+    if (status) fclose(status);
+    if (peak < 0) {  // Нет /proc — берём пик за всё время работы процесса
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) == 0) peak = ru.ru_maxrss;
+    }
+
+    return peak;
+}
+
+// Сбрасываем счётчик пиковой памяти, чтобы каждый случай бенчмарка мерился отдельно (Linux)
+void bench_reset_peak(void) {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f) {
+        fputs("5", f);
+        fclose(f);
+    }
+}
+
+// Генератор псевдослучайных чисел splitmix64
+uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Заполняем поле случайными клетками с долей живых density
+void random_field(field *f, double density, uint64_t seed) {
+    uint64_t threshold = (uint64_t)(density * 18446744073709551615.0);
+
+    for (int i = 0; i < f->height; i++) {
+        for (int j = 0; j < f->width; j++) CELL(f, i, j) = splitmix64(&seed) < threshold;
+    }
+}
+
+// Замер одного случая: движок type на начальном поле start. Поколения считаются пачками,
+// удваивая размер пачки, пока замер не займёт BENCH_MIN_TIME. Результат — строка JSON
+int bench_case(const options *opt, int type, const field *start, const char *board, double density) {
+    engine e = {0};
+    int success;
+
+    bench_reset_peak();
+    success = engine_create(&e, type, start->height, start->width, opt->threads, BOUNDARY_TORUS, opt->disk) &&
+              engine_stage(&e, start->height, start->width, 0) && engine_temporal(&e, opt->temporal_k);
+    if (success) {
+        memcpy(e.curr->cells, start->cells, (size_t)start->height * start->stride);
+        success = engine_load(&e) && engine_advance(&e, 1);  // Первый шаг — прогрев кэшей и таблиц
+    }
+    if (success) {
+        uint64_t gens = 0, batch = 1;
+        double begin = now_seconds(), elapsed = 0;
+        while (success && elapsed < BENCH_MIN_TIME && gens < BENCH_MAX_GENS) {
+            success = engine_advance(&e, batch);
+            gens += batch;
+            batch *= 2;
+            elapsed = now_seconds() - begin;
+        }
+        double cells = (double)start->height * start->width;
+        char name[24];  // Правило в виде B3/S23
+        format_rule(&life_rule, name);
+        printf("{\"engine\":\"%s\",\"isa\":\"%s\",\"threads\":%d,\"temporal_k\":%d,\"rule\":\"%s\","
+               "\"board\":\"%s\",\"width\":%d,\"height\":%d,\"density\":%.2f,\"generations\":%llu,"
+               "\"seconds\":%.6f,\"gens_per_sec\":%.1f,\"ns_per_cell\":%.4f,\"peak_rss_kb\":%ld}\n",
+               engine_names[type], type == ENGINE_SIMD ? simd_isa : "-", e.threads, e.temporal, name, board,
+               start->width, start->height, density, (unsigned long long)gens, elapsed, gens / elapsed,
+               elapsed * 1e9 / ((double)gens * cells), bench_peak_rss());
+        fflush(stdout);
+    }
+    if (!success) fprintf(stderr, "Benchmark %s on %s failed\n", engine_names[type], board);
+    engine_free(&e);
+
+    return success;
+}
+
+// Читаем поле из файла шаблона (размеры берутся из самого файла)
+field *load_pattern(const char *path) {
+    options none = {0};  // Без --size
+    board_file b;
+    field *f = NULL;
+
+    if (open_board(path, &b)) {
+        int height, width;
+        board_size(&b, &none, &height, &width);
+        f = create_field(height, width);
+        if (f && !read_board(&b, f, 1)) {
+            free_field(f);
+            f = NULL;
+        }
+        close_board(&b);
+    }
+
+    return f;
+}
+
+// Бенчмарк: каждый движок на каждом шаблоне каталога и на случайных полях нескольких размеров
+// и плотностей. Каждая строка вывода — JSON-объект с поколениями в секунду, нс на клетку и пиком памяти
+int run_bench(const options *opt) {
+    static const int sides[] = {128, 512, 2048};          // Стороны случайных квадратных полей
+    static const double densities[] = {0.05, 0.3, 0.5};  // Доли живых клеток
+    int success = 1;
+    DIR *dir = opendir(opt->input);
+
+    rule_init(&opt->rule);  // Ядра правила; заодно выбирается набор инструкций для отчёта
+    if (!dir) fprintf(stderr, "Cannot open patterns directory: %s\n", opt->input);
+    for (struct dirent *ent = dir ? readdir(dir) : NULL; ent && success; ent = readdir(dir)) {
+        const char *ext = strrchr(ent->d_name, '.');  // Шаблоны в любом из читаемых форматов
+        if (ext && (strcmp(ext, ".txt") == 0 || strcmp(ext, ".rle") == 0 || strcmp(ext, ".cells") == 0)) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", opt->input, ent->d_name);
+            field *f = load_pattern(path);
+            if (!f) fprintf(stderr, "Skipping %s: cannot read pattern\n", path);
+            for (int type = 0; f && type < ENGINE_COUNT && success; type++) {
+                if ((!opt->engine_given || type == opt->engine) && rule_supported(type, &life_rule)) {
+                    success = bench_case(opt, type, f, ent->d_name, -1);
+                }
+            }
+            free_field(f);
+        }
+    }
+    if (dir) closedir(dir);
+
+    for (size_t s = 0; s < sizeof(sides) / sizeof(sides[0]) && success; s++) {
+        for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]) && success; d++) {
+            field *f = create_field(sides[s], sides[s]);
+            success = f != NULL;
+            if (f) random_field(f, densities[d], BENCH_SEED + s * 16 + d);
+            for (int type = 0; f && type < ENGINE_COUNT && success; type++) {
+                if ((!opt->engine_given || type == opt->engine) && rule_supported(type, &life_rule)) {
+                    success = bench_case(opt, type, f, "random", densities[d]);
+                }
+            }
+            free_field(f);
+        }
+    }
+
+    return success;
+}
+
+// Объект переписи в одной фазе: рамка и строки-маски, клетка (top + y, left + x) — бит x строки y
+typedef struct {
+    int height;            // Размеры рамки
+    int width;
+    int64_t top;           // Положение рамки на плоскости
+    int64_t left;
+    uint64_t population;   // Живых клеток
+    uint64_t rows[SOUP_OBJECT_SIDE];
+} soup_shape;
+
+// Строка переписи: ключ объекта и сколько раз он встретился
+typedef struct {
+    char *key;
+    uint64_t count;
+} census_entry;
+
+// Перепись объектов: хеш-таблица ключей с открытой адресацией (заполнена не больше чем наполовину)
+typedef struct {
+    census_entry *table;
+    size_t buckets;  // Степень двойки
+    size_t count;    // Разных ключей
+} census;
+
+// Поток поиска: берёт супы по номеру из общего счётчика и ведёт свою перепись — итог не зависит
+// от числа потоков и от того, какой поток какой суп посчитал
+typedef struct {
+    const options *opt;
+    _Atomic long long *next;  // Номер следующего супа
+    pthread_t thread;
+    census found;             // Перепись объектов этого потока
+    uint64_t objects;         // Объектов найдено
+    uint64_t unstable;        // Супов, не успокоившихся за SOUP_MAX_GENS
+    uint64_t generations;     // Поколений посчитано
+    int failed;               // Не хватило памяти
+} soup_worker;
+
+// Хеш FNV-1a ключа переписи
+static uint64_t census_hash(const char *key) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (; *key; key++) h = (h ^ (unsigned char)*key) * 0x100000001B3ull;
+    return h;
+}
+
+// Прибавляем n встреч объекта key (ключ копируется). 0 — не хватило памяти
+int census_add(census *c, const char *key, uint64_t n) {
+    size_t k;
+
+    if ((c->count + 1) * 2 > c->buckets) {  // Растим таблицу вдвое и раскладываем ключи заново
+        size_t buckets = c->buckets ? c->buckets * 2 : 64;
+        census_entry *table = calloc(buckets, sizeof(census_entry));
+        if (!table) return 0;
+        for (size_t i = 0; i < c->buckets; i++) {
+            if (!c->table[i].key) continue;
+            k = census_hash(c->table[i].key) & (buckets - 1);
+            while (table[k].key) k = (k + 1) & (buckets - 1);
+            table[k] = c->table[i];
         }
-    } else {
-        success = 0;  // Ошибка выделения памяти под массив указателей
+        free(c->table);
+        c->table = table;
+        c->buckets = buckets;
     }
+    k = census_hash(key) & (c->buckets - 1);
+    while (c->table[k].key && strcmp(c->table[k].key, key) != 0) k = (k + 1) & (c->buckets - 1);
+    if (!c->table[k].key) {
+        if (!(c->table[k].key = strdup(key))) return 0;
+        c->count++;
+    }
+    c->table[k].count += n;
+
+    return 1;
+}
+
+// Освобождаем перепись
+void census_free(census *c) {
+    for (size_t i = 0; i < c->buckets; i++) free(c->table[i].key);
+    free(c->table);
+    c->table = NULL;
+    c->buckets = c->count = 0;
+}
+
+// Живые клетки плоскости парами (y, x) в *cells (буфер растёт по необходимости). -1 — нет памяти
+static long soup_cells(const chunkmap *m, int64_t **cells, size_t *cap) {
+    size_t n = 0;
 
-    if (!success) {  // Если что-то пошло не так
-        if (field) {  // Если хоть что-то выделилось — освобождаем всю память
-            for (int i = 0; i < HEIGHT; i++) free(field[i]);  // Освобождаем строки
-            free(field);  // Освобождаем массив указателей
+    for (size_t i = 0; i < m->count; i++) {
+        const chunk *c = m->list[i];
+        for (int r = 0; r < CHUNK_SIDE; r++) {
+            for (uint64_t word = c->rows[m->cur][r]; word; word &= word - 1) {
+                if (n == *cap) {
+                    size_t size = *cap ? *cap * 2 : 256;
+                    int64_t *grown = realloc(*cells, size * 2 * sizeof(int64_t));
+                    if (!grown) return -1;
+                    *cells = grown;
+                    *cap = size;
+                }
+                (*cells)[2 * n] = c->cy * CHUNK_SIDE + r;
+                (*cells)[2 * n + 1] = c->cx * CHUNK_SIDE + __builtin_ctzll(word);
+                n++;
+            }
         }
-        field = NULL;  // Помечаем, что памяти нет
     }
 
-    return field;  // Возвращаем указатель на поле или NULL при ошибке
+    return (long)n;
 }
 
-// Освобождаем память поля
-void free_field(int **field) {
-    for (int i = 0; i < HEIGHT; i++) {  // Для каждой строки
-        free(field[i]);                 // Освобождаем память строки
+// Фаза объекта с плоскости. 0 — объект не помещается в SOUP_OBJECT_SIDE x SOUP_OBJECT_SIDE
+static int soup_shape_of(const chunkmap *m, soup_shape *sh) {
+    int64_t top = INT64_MAX, left = INT64_MAX, bottom = INT64_MIN, right = INT64_MIN;
+
+    for (size_t i = 0; i < m->count; i++) {  // Первый проход — рамка
+        const chunk *c = m->list[i];
+        for (int r = 0; r < CHUNK_SIDE; r++) {
+            uint64_t word = c->rows[m->cur][r];
+            if (!word) continue;
+            int64_t y = c->cy * CHUNK_SIDE + r, x = c->cx * CHUNK_SIDE;
+            if (y < top) top = y;
+            if (y > bottom) bottom = y;
+            if (x + __builtin_ctzll(word) < left) left = x + __builtin_ctzll(word);
+            if (x + 63 - __builtin_clzll(word) > right) right = x + 63 - __builtin_clzll(word);
+        }
+    }
+    memset(sh, 0, sizeof(soup_shape));
+    if (top == INT64_MAX) return 1;  // Пусто
+    if (bottom - top >= SOUP_OBJECT_SIDE || right - left >= SOUP_OBJECT_SIDE) return 0;
+    sh->height = (int)(bottom - top + 1);
+    sh->width = (int)(right - left + 1);
+    sh->top = top;
+    sh->left = left;
+    for (size_t i = 0; i < m->count; i++) {  // Второй проход — клетки
+        const chunk *c = m->list[i];
+        for (int r = 0; r < CHUNK_SIDE; r++) {
+            for (uint64_t word = c->rows[m->cur][r]; word; word &= word - 1) {
+                int64_t x = c->cx * CHUNK_SIDE + __builtin_ctzll(word);
+                sh->rows[c->cy * CHUNK_SIDE + r - top] |= (uint64_t)1 << (x - left);
+                sh->population++;
+            }
+        }
     }
-    free(field);  // Освобождаем массив указателей
+
+    return 1;
 }
 
-// Читаем игровое поле из stdin построчно, проверяем входные данные
-int read_field(int **field) {
-    int success = 1;  // Флаг успеха чтения
-    char line[4096];  // Буфер для строки
+// Кладём фазу объекта на пустую плоскость; рамка — в начале координат
+static int soup_place(chunkmap *m, const soup_shape *sh) {
+    int success = 1;
 
-    for (int i = 0; i < HEIGHT && success; i++) {           // Считываем ровно 25 строк
-        if (!fgets(line, sizeof(line), stdin)) {            // Считываем строку из stdin
-            fprintf(stderr, "Error reading line %d\n", i);  // Если не удалось — ошибка
-            success = 0;
+    for (size_t i = 0; i < m->count; i++) free(m->list[i]);
+    m->count = 0;
+    chunk_index(m);
+    for (int y = 0; y < sh->height && success; y++) {
+        chunk *c = sh->rows[y] ? chunk_add(m, y / CHUNK_SIDE, 0) : NULL;  // Ширина не больше участка
+        if (c) c->rows[m->cur][y % CHUNK_SIDE] = sh->rows[y];
+        success = c || !sh->rows[y];
+    }
+
+    return success;
+}
+
+// Одна и та же фаза с точностью до сдвига
+static int soup_same(const soup_shape *a, const soup_shape *b) {
+    return a->height == b->height && a->width == b->width && a->population == b->population &&
+           memcmp(a->rows, b->rows, (size_t)a->height * sizeof(uint64_t)) == 0;
+}
+
+// Запись фазы в симметрии sym (бит 0 — отражение по x, бит 1 — по y, бит 2 — транспонирование):
+// "WxH_" и строки шестнадцатеричными числами по (W + 3) / 4 цифры
+static void soup_code(const soup_shape *sh, int sym, char *out) {
+    uint64_t rows[SOUP_OBJECT_SIDE] = {0};
+    int h = sym & 4 ? sh->width : sh->height, w = sym & 4 ? sh->height : sh->width, digits = (w + 3) / 4;
+
+    for (int y = 0; y < sh->height; y++) {
+        for (uint64_t word = sh->rows[y]; word; word &= word - 1) {
+            int x = __builtin_ctzll(word);
+            int ty = sym & 2 ? sh->height - 1 - y : y, tx = sym & 1 ? sh->width - 1 - x : x;
+            if (sym & 4) {
+                int t = ty;
+                ty = tx;
+                tx = t;
+            }
+            rows[ty] |= (uint64_t)1 << tx;
+        }
+    }
+    out += sprintf(out, "%dx%d_", w, h);
+    for (int y = 0; y < h; y++) out += sprintf(out, "%0*llx", digits, (unsigned long long)rows[y]);
+}
+
+// Класс объекта из n клеток: ведём его отдельно, пока фаза не повторится (с точностью до сдвига),
+// и берём наименьшую запись по всем фазам и восьми симметриям. Ключ — xs<население> для натюрмортов,
+// xp<период> для осцилляторов, xq<период> для кораблей (как в apgcode, но со своей записью клеток);
+// слишком большие, растущие или не повторившиеся объекты — messy. 0 — не хватило памяти
+static int soup_classify(chunkmap *m, const int64_t *cells, size_t n, soup_shape *phases, char *key) {
+    int64_t top = INT64_MAX, left = INT64_MAX, bottom = INT64_MIN, right = INT64_MIN;
+    int period = 0;
+    char code[SOUP_KEY];
+
+    for (size_t k = 0; k < n; k++) {
+        if (cells[2 * k] < top) top = cells[2 * k];
+        if (cells[2 * k] > bottom) bottom = cells[2 * k];
+        if (cells[2 * k + 1] < left) left = cells[2 * k + 1];
+        if (cells[2 * k + 1] > right) right = cells[2 * k + 1];
+    }
+    strcpy(key, "messy");
+    if (!n || bottom - top >= SOUP_OBJECT_SIDE || right - left >= SOUP_OBJECT_SIDE) return 1;
+    memset(&phases[0], 0, sizeof(soup_shape));
+    phases[0].height = (int)(bottom - top + 1);
+    phases[0].width = (int)(right - left + 1);
+    phases[0].population = n;
+    for (size_t k = 0; k < n; k++) {
+        phases[0].rows[cells[2 * k] - top] |= (uint64_t)1 << (cells[2 * k + 1] - left);
+    }
+    if (!soup_place(m, &phases[0])) return 0;
+    for (int t = 1; t <= SOUP_MAX_PERIOD && !period; t++) {
+        if (!chunkmap_step(m, NULL)) return 0;
+        if (!soup_shape_of(m, &phases[t]) || !phases[t].population) return 1;
+        if (soup_same(&phases[t], &phases[0])) period = t;
+    }
+    if (!period) return 1;
+
+    if (phases[period].top != phases[0].top || phases[period].left != phases[0].left) {
+        sprintf(key, "xq%d_", period);  // Фаза повторилась на новом месте — корабль
+    } else if (period == 1) {
+        sprintf(key, "xs%llu_", (unsigned long long)n);
+    } else {
+        sprintf(key, "xp%d_", period);
+    }
+    char *best = key + strlen(key);
+    best[0] = '\0';
+    for (int t = 0; t < period; t++) {
+        for (int sym = 0; sym < 8; sym++) {
+            soup_code(&phases[t], sym, code);
+            size_t len = strlen(code), have = strlen(best);  // Короче — меньше, при равной длине — по strcmp
+            if (!best[0] || len < have || (len == have && strcmp(code, best) < 0)) {
+                strcpy(best, code);
+            }
+        }
+    }
+
+    return 1;
+}
+
+// Клетка огибающей успокоившегося супа (объединения его фаз за период)
+typedef struct {
+    int64_t y;
+    int64_t x;
+    size_t near;   // Корень группы по соседству (расстояние 1): кандидат в отдельный объект
+    size_t far;    // Корень группы по расстоянию 2: объект, если кандидаты по отдельности не живут
+    int live;      // Клетка жива в исходной фазе
+} soup_cell;
+
+// Буферы потока поиска, переиспользуемые от супа к супу
+typedef struct {
+    soup_cell *cells;    // Огибающая супа
+    size_t count;        // Клеток в ней
+    size_t cap;          // Размер cells
+    int64_t *phase;      // Клетки одной фазы парами (y, x)
+    size_t phase_cap;    // Размер phase в клетках
+    int64_t *object;     // Живые клетки классифицируемого объекта парами (y, x)
+    size_t *near;        // Лес объединения по соседству
+    size_t *far;         // Лес объединения по расстоянию 2
+    size_t *table;       // Хеш-таблица клеток огибающей: номер клетки + 1 (0 — пусто)
+    size_t size;         // Размер object, near и far в клетках (table — вдвое больше)
+    char *keys;          // Ключи кандидатов одной дальней группы по SOUP_KEY байт
+    size_t keys_cap;     // Размер keys в ключах
+    soup_shape *phases;  // Фазы классифицируемого объекта
+} soup_scratch;
+
+// Корень клетки k в лесе объединения (со сжатием путей)
+static size_t soup_root(size_t *parent, size_t k) {
+    while (parent[k] != k) {
+        parent[k] = parent[parent[k]];
+        k = parent[k];
+    }
+    return k;
+}
+
+// Порядок клеток огибающей: по координатам — чтобы слить повторы из разных фаз
+static int soup_by_place(const void *a, const void *b) {
+    const soup_cell *p = a, *q = b;
+    if (p->y != q->y) return p->y < q->y ? -1 : 1;
+    return p->x < q->x ? -1 : p->x > q->x;
+}
+
+// Порядок клеток огибающей: по дальней группе, внутри неё — по ближней
+static int soup_by_group(const void *a, const void *b) {
+    const soup_cell *p = a, *q = b;
+    if (p->far != q->far) return p->far < q->far ? -1 : 1;
+    if (p->near != q->near) return p->near < q->near ? -1 : 1;
+    return soup_by_place(a, b);
+}
+
+// Живые клетки группы cells[from, to) в s->object и класс объекта из них
+static int soup_group(soup_scratch *s, chunkmap *obj, size_t from, size_t to, char *key) {
+    size_t n = 0;
+
+    for (size_t k = from; k < to; k++) {
+        if (!s->cells[k].live) continue;
+        s->object[2 * n] = s->cells[k].y;
+        s->object[2 * n + 1] = s->cells[k].x;
+        n++;
+    }
+    return soup_classify(obj, s->object, n, s->phases, key);
+}
+
+// Перепись успокоившегося супа с периодом period. Объекты выделяются по огибающей за период (так
+// осциллятор не распадается на фазы): клетки на расстоянии 1 — кандидат в объект, на расстоянии 2 —
+// дальняя группа. Кандидаты идут в перепись по отдельности, если каждый из них сам по себе повторяется,
+// иначе (например, псевдонатюрморт, который держится только вместе) — вся дальняя группа одним
+// объектом. Плоскость m при этом проходит ещё один период. 0 — не хватило памяти
+static int soup_census(soup_worker *w, chunkmap *m, chunkmap *obj, soup_scratch *s, int period) {
+    size_t n = 0, mask;
+
+    s->count = 0;
+    for (int t = 0; t < period; t++) {  // Огибающая: клетки всех фаз подряд, затем без повторов
+        long cells = t && !chunkmap_step(m, NULL) ? -1 : soup_cells(m, &s->phase, &s->phase_cap);
+        if (cells < 0) return 0;
+        if (s->count + (size_t)cells > s->cap) {
+            size_t cap = s->cap ? s->cap : 256;
+            while (cap < s->count + (size_t)cells) cap *= 2;
+            soup_cell *grown = realloc(s->cells, cap * sizeof(soup_cell));
+            if (!grown) return 0;
+            s->cells = grown;
+            s->cap = cap;
+        }
+        for (long k = 0; k < cells; k++) {
+            soup_cell c = {s->phase[2 * k], s->phase[2 * k + 1], 0, 0, t == 0};
+            s->cells[s->count++] = c;
+        }
+    }
+    qsort(s->cells, s->count, sizeof(soup_cell), soup_by_place);
+    for (size_t k = 0; k < s->count; k++) {
+        if (n && s->cells[n - 1].y == s->cells[k].y && s->cells[n - 1].x == s->cells[k].x) {
+            s->cells[n - 1].live |= s->cells[k].live;
         } else {
-            int count = 0;     // Счётчик чисел в строке
-            char *ptr = line;  // Указатель на текущий символ в строке
+            s->cells[n++] = s->cells[k];
+        }
+    }
+    s->count = n;
 
-            for (int j = 0; j < WIDTH; j++) {  // Читаем 80 чисел в строке
-                int val, offset;  // val — прочитанное число, offset — сколько символов прочитано
-                if (sscanf(ptr, "%d%n", &val, &offset) != 1) {  // Пытаемся прочитать число
-                    fprintf(stderr, "Line %d: expected integer at position %d\n", i + 1, count + 1);
-                    success = 0;  // Ошибка — число не прочитано
-                    break;
+    if (n > s->size) {
+        size_t size = s->size ? s->size : 256;
+        while (size < n) size *= 2;
+        free(s->object);
+        free(s->near);
+        free(s->far);
+        free(s->table);
+        s->object = malloc(size * 2 * sizeof(int64_t));
+        s->near = malloc(size * sizeof(size_t));
+        s->far = malloc(size * sizeof(size_t));
+        s->table = malloc(2 * size * sizeof(size_t));
+        s->size = s->object && s->near && s->far && s->table ? size : 0;
+        if (!s->size) return 0;
+    }
+    mask = 2 * s->size - 1;
+    memset(s->table, 0, 2 * s->size * sizeof(size_t));
+    for (size_t k = 0; k < n; k++) {
+        size_t h = chunk_hash(s->cells[k].y, s->cells[k].x) & mask;
+        while (s->table[h]) h = (h + 1) & mask;
+        s->table[h] = k + 1;
+        s->near[k] = s->far[k] = k;
+    }
+    for (size_t k = 0; k < n; k++) {  // Объединяем с соседями в квадрате 5x5 (ближние — в 3x3)
+        for (int dy = -2; dy <= 2; dy++) {
+            for (int dx = -2; dx <= 2; dx++) {
+                int64_t y = s->cells[k].y + dy, x = s->cells[k].x + dx;
+                size_t h = chunk_hash(y, x) & mask;
+                const soup_cell *c;
+                while (s->table[h] && ((c = &s->cells[s->table[h] - 1])->y != y || c->x != x)) {
+                    h = (h + 1) & mask;
                 }
-                if (val != 0 && val != 1) {  // Проверяем, что число либо 0, либо 1
-                    fprintf(stderr, "Line %d: invalid value %d at position %d (only 0 or 1 allowed)\n", i + 1,
-                            val, count + 1);
-                    success = 0;  // Ошибка — неверное значение
-                    break;
+                if (!s->table[h]) continue;
+                s->far[soup_root(s->far, s->table[h] - 1)] = soup_root(s->far, k);
+                if (dy >= -1 && dy <= 1 && dx >= -1 && dx <= 1) {
+                    s->near[soup_root(s->near, s->table[h] - 1)] = soup_root(s->near, k);
                 }
-                field[i][j] = val;  // Записываем значение в поле
-                ptr += offset;  // Смещаем указатель на количество прочитанных символов
-                count++;  // Увеличиваем счётчик прочитанных чисел
             }
+        }
+    }
+    for (size_t k = 0; k < n; k++) {
+        s->cells[k].near = soup_root(s->near, k);
+        s->cells[k].far = soup_root(s->far, k);
+    }
+    qsort(s->cells, n, sizeof(soup_cell), soup_by_group);
 
-            // Проверяем, нет ли лишних символов после 80 чисел
-            while (*ptr != '\0') {                                  // Пока не конец строки
-                if (*ptr != ' ' && *ptr != '\n' && *ptr != '\t') {  // Если не пробельный символ — ошибка
-                    fprintf(stderr, "Line %d: extra characters after 80 numbers\n", i + 1);
-                    success = 0;
-                    break;
+    for (size_t from = 0, to; from < n; from = to) {  // Дальние группы
+        size_t parts = 0, at = from;
+        int whole = 0;  // Кандидаты не живут по отдельности — берём группу целиком
+        for (to = from; to < n && s->cells[to].far == s->cells[from].far; to++) {
+        }
+        while (at < to && !whole) {  // Кандидаты группы
+            size_t end = at;
+            while (end < to && s->cells[end].near == s->cells[at].near) end++;
+            if (parts == s->keys_cap) {
+                size_t cap = s->keys_cap ? s->keys_cap * 2 : 16;
+                char *grown = realloc(s->keys, cap * SOUP_KEY);
+                if (!grown) return 0;
+                s->keys = grown;
+                s->keys_cap = cap;
+            }
+            if (!soup_group(s, obj, at, end, s->keys + parts * SOUP_KEY)) return 0;
+            whole = strcmp(s->keys + parts * SOUP_KEY, "messy") == 0;
+            parts++;
+            at = end;
+        }
+        if (whole) {
+            if (!soup_group(s, obj, from, to, s->keys)) return 0;
+            parts = 1;
+        }
+        for (size_t k = 0; k < parts; k++) {
+            if (!census_add(&w->found, s->keys + k * SOUP_KEY, 1)) return 0;
+        }
+        w->objects += parts;
+    }
+
+    return 1;
+}
+
+// Ведём суп до стабилизации: населённость повторяется с периодом до SOUP_MAX_PERIOD на протяжении
+// 2 * SOUP_MAX_PERIOD поколений (улетающие корабли населённость не меняют). 1 — успокоился с периодом
+// *period, 0 — нет за SOUP_MAX_GENS поколений или вырос больше SOUP_MAX_POP, -1 — не хватило памяти
+static int soup_settle(chunkmap *m, uint64_t *gens, int *period) {
+    uint64_t pop[SOUP_HISTORY];  // Населённость поколения g — в pop[g % SOUP_HISTORY]
+
+    for (uint64_t g = 1; g <= SOUP_MAX_GENS; g++) {
+        gen_stats st;
+        stats_reset(&st);
+        if (!chunkmap_step(m, &st)) return -1;
+        pop[g % SOUP_HISTORY] = st.population;
+        *gens = g;
+        if (st.population > SOUP_MAX_POP) return 0;
+        *period = 1;
+        if (!st.population) return 1;
+        if (g >= 4 * SOUP_MAX_PERIOD && g % 30 == 0) {  // Проверка раз в 30 поколений
+            for (int p = 1; p <= SOUP_MAX_PERIOD; p++) {
+                uint64_t k = 0;
+                while (k < 2 * SOUP_MAX_PERIOD &&
+                       pop[(g - k) % SOUP_HISTORY] == pop[(g - k - p) % SOUP_HISTORY]) {
+                    k++;
                 }
-                ptr++;  // Идём дальше по строке
+                *period = p;
+                if (k == 2 * SOUP_MAX_PERIOD) return 1;
             }
         }
     }
 
-    // Проверяем, что после 25 строк нет других символов кроме пробелов и переводов строки
-    int c = getchar();                             // Читаем следующий символ
-    while (c != EOF) {                             // Пока не конец файла
-        if (c != ' ' && c != '\n' && c != '\t') {  // Если не пробельный символ — ошибка
-            fprintf(stderr, "Input has extra lines beyond 25 rows\n");
+    return 0;
+}
+
+// Суп номер i: SOUP_SIDE x SOUP_SIDE случайных клеток из зерна, смешанного с номером
+static void soup_field(field *f, uint64_t seed, long long i) {
+    uint64_t state = seed ^ (uint64_t)i * 0xD1B54A32D192ED03ull;
+    random_field(f, 0.5, splitmix64(&state));
+}
+
+// Поток поиска
+void *soup_thread(void *arg) {
+    soup_worker *w = arg;
+    soup_scratch s = {0};
+    chunkmap *m = create_chunkmap(), *obj = create_chunkmap();
+    field *f = create_field(SOUP_SIDE, SOUP_SIDE);
+    long long i;
+
+    s.phases = malloc((SOUP_MAX_PERIOD + 1) * sizeof(soup_shape));
+    w->failed = !m || !obj || !f || !s.phases;
+    while (!w->failed && (i = atomic_fetch_add(w->next, 1)) < w->opt->soup) {
+        uint64_t gens = 0;
+        int settled, period;
+        soup_field(f, w->opt->seed, i);
+        settled = chunkmap_load(m, f) ? soup_settle(m, &gens, &period) : -1;
+        w->generations += gens;
+        if (settled == 0) w->unstable++;
+        if (settled < 0 || (settled > 0 && !soup_census(w, m, obj, &s, period))) w->failed = 1;
+    }
+    free_chunkmap(m);
+    free_chunkmap(obj);
+    free_field(f);
+    free(s.cells);
+    free(s.phase);
+    free(s.object);
+    free(s.near);
+    free(s.far);
+    free(s.table);
+    free(s.keys);
+    free(s.phases);
+
+    return NULL;
+}
+
+// Строки итоговой переписи: чаще встречающиеся первыми, при равенстве — по ключу
+static int census_order(const void *a, const void *b) {
+    const census_entry *x = a, *y = b;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    return strcmp(x->key, y->key);
+}
+
+// Имена известных объектов правила B3/S23 ('o' — живая клетка, '/' — конец строки); их ключи
+// считаются тем же классификатором, что и перепись
+static const char *const soup_known[][2] = {
+    {"block", "oo/oo"},
+    {"blinker", "ooo"},
+    {"beehive", ".oo./o..o/.oo."},
+    {"loaf", ".oo./o..o/.o.o/..o."},
+    {"boat", "oo./o.o/.o."},
+    {"ship", "oo./o.o/.oo"},
+    {"tub", ".o./o.o/.o."},
+    {"pond", ".oo./o..o/o..o/.oo."},
+    {"long boat", "oo../o.o./.o.o/..o."},
+    {"barge", ".o../o.o./.o.o/..o."},
+    {"mango", ".oo../o..o./.o..o/..oo."},
+    {"eater", "oo../o.o./..o./..oo"},
+    {"snake", "oo.o/o.oo"},
+    {"aircraft carrier", "oo../o..o/..oo"},
+    {"toad", ".ooo/ooo."},
+    {"beacon", "oo../oo../..oo/..oo"},
+    {"glider", ".o./..o/ooo"},
+    {"lightweight spaceship", ".o..o/o..../o...o/oooo."},
+    {"middleweight spaceship", "...o../.o...o/o...../o....o/ooooo."},
+};
+
+// Ключ известного объекта по его рисунку; "" — не удалось
+static void soup_known_key(const char *picture, chunkmap *m, soup_shape *phases, char *key) {
+    int64_t cells[2 * 64];
+    size_t n = 0;
+
+    key[0] = '\0';
+    for (int y = 0, x = 0; *picture; picture++) {
+        if (*picture == '/') {
+            y++;
+            x = 0;
+            continue;
+        }
+        if (*picture == 'o' && n < 64) {
+            cells[2 * n] = y;
+            cells[2 * n + 1] = x;
+            n++;
+        }
+        x++;
+    }
+    if (!soup_classify(m, cells, n, phases, key)) key[0] = '\0';
+}
+
+// Поиск по случайным супам: --soup N супов из зерна --seed считаются в --threads потоках (по умолчанию —
+// по числу процессоров) на плоскости участков до стабилизации, остатки делятся на объекты
+// и классифицируются. Перепись — в --output или stdout, скорость в супах в секунду — в stderr
+int run_soup(const options *opt) {
+    int pool = opt->threads_given ? opt->threads : online_cpus(MAX_THREADS);  // Потоков поиска
+    int threads = pool, success = rule_supported(ENGINE_CHUNKS, &opt->rule);  // Запущено потоков
+    soup_worker *workers = calloc((size_t)pool, sizeof(soup_worker));
+    _Atomic long long next = 0;
+    census total = {0};
+    uint64_t objects = 0, unstable = 0, generations = 0;
+    double begin = now_seconds(), elapsed;
+    FILE *out = NULL;
+
+    rule_init(&opt->rule);
+    if (!success) fprintf(stderr, "Rule with B0 cannot run on the unbounded chunks plane\n");
+    if (success && !workers) {
+        fprintf(stderr, "Memory allocation error\n");
+        success = 0;
+    }
+    for (int t = 0; t < threads && success; t++) {
+        workers[t].opt = opt;
+        workers[t].next = &next;
+        if (pthread_create(&workers[t].thread, NULL, soup_thread, &workers[t]) != 0) {
+            workers[t].failed = 1;
+            threads = t;  // Ждём только запущенные
+            atomic_store(&next, opt->soup);
+            fprintf(stderr, "Cannot start search thread\n");
+        }
+    }
+    for (int t = 0; t < threads && success; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    elapsed = now_seconds() - begin;
+    for (int t = 0; t < pool && workers; t++) {  // Сводим переписи потоков
+        soup_worker *w = &workers[t];
+        int merged = !w->failed;
+        for (size_t k = 0; k < w->found.buckets && merged; k++) {
+            const census_entry *e = &w->found.table[k];
+            if (e->key) merged = census_add(&total, e->key, e->count);
+        }
+        if (success && !merged) {
+            fprintf(stderr, "Soup search failed: out of memory\n");
             success = 0;
-            break;
         }
-        c = getchar();  // Следующий символ
+        objects += w->objects;
+        unstable += w->unstable;
+        generations += w->generations;
+        census_free(&w->found);
+    }
+
+    if (success && !(out = opt->output ? fopen(opt->output, "w") : stdout)) {
+        fprintf(stderr, "Cannot open output file: %s\n", opt->output);
+        success = 0;
+    }
+    if (success) {
+        size_t count = 0, known = sizeof(soup_known) / sizeof(soup_known[0]);
+        census_entry *rows = malloc((total.count + 1) * sizeof(census_entry));
+        char (*keys)[SOUP_KEY] = calloc(known, SOUP_KEY);
+        chunkmap *m = create_chunkmap();
+        soup_shape *phases = malloc((SOUP_MAX_PERIOD + 1) * sizeof(soup_shape));
+        int conway = life_rule.birth == LIFE_BIRTH && life_rule.survive == LIFE_SURVIVE;
+        char name[24];
+
+        success = rows && keys && m && phases;
+        for (size_t k = 0; k < known && success && conway; k++) {
+            soup_known_key(soup_known[k][1], m, phases, keys[k]);
+        }
+        for (size_t k = 0; k < total.buckets && success; k++) {
+            if (total.table[k].key) rows[count++] = total.table[k];
+        }
+        if (success) qsort(rows, count, sizeof(census_entry), census_order);
+        format_rule(&life_rule, name);
+        if (success) fprintf(out, "# %lld soups %dx%d, seed %llu, rule %s\n", opt->soup, SOUP_SIDE, SOUP_SIDE,
+                             (unsigned long long)opt->seed, name);
+        for (size_t r = 0; r < count && success; r++) {
+            const char *label = "";
+            for (size_t k = 0; k < known && conway; k++) {
+                if (strcmp(keys[k], rows[r].key) == 0) label = soup_known[k][0];
+            }
+            fprintf(out, "%llu %s%s%s\n", (unsigned long long)rows[r].count, rows[r].key, label[0] ? " " : "",
+                    label);
+        }
+        if (!success) fprintf(stderr, "Memory allocation error\n");
+        if (out != stdout && fclose(out) != 0) success = 0;
+        free(rows);
+        free(keys);
+        free(phases);
+        free_chunkmap(m);
     }
+    if (success) {
+        fprintf(stderr, "%lld soups in %.3f s: %.1f soups/s, %llu generations, %llu objects, %llu unstable\n",
+                opt->soup, elapsed, elapsed > 0 ? (double)opt->soup / elapsed : 0.0,
+                (unsigned long long)generations, (unsigned long long)objects, (unsigned long long)unstable);
+    }
+    census_free(&total);
+    free(workers);
 
-    return success;  // Возвращаем 1 если успешно, иначе 0
+    return success;
 }
 
-// Подсчёт количества живых соседей у клетки с координатами (x, y)
-// Учтено замыкание поля по горизонтали и вертикали (тор)
-int neighbors(int **f, int x, int y) {
-    int count = 0;  // Кол-во живых соседей
+// Состояние потока симуляции интерактивного режима. Интерфейс каждый кадр пополняет budget
+// по цели скорости, поток симуляции считает их шагами до per_frame поколений и публикует каждый шаг
+// в frames
+typedef struct {
+    engine *eng;                 // Движок (им владеет только поток симуляции)
+    const options *opt;
+    checkpoint *ck;              // Периодические контрольные точки пишет поток симуляции
+    triple_buffer frames;        // Готовые поколения для отрисовки
+    _Atomic uint64_t budget;     // Поколения, которые ещё нужно посчитать
+    _Atomic uint64_t per_frame;  // Наибольший шаг между публикациями (клавиши S/X, Hashlife прыгает на него)
+    _Atomic int stop;            // Интерфейс завершает работу
+    _Atomic int failed;          // Симуляция остановилась (Hashlife: нехватка памяти или край плоскости)
+    _Atomic int ck_failed;       // Контрольная точка не записалась (следующие уже не пишутся)
+    cycle_finder cycles;         // Поиск циклов (только в потоке симуляции)
+    _Atomic uint64_t period;     // Найденный период для строки состояния (0 — цикла нет)
+} sim_state;
 
-    for (int dx = -1; dx <= 1; dx++) {      // Проходим по смещению по вертикали
-        for (int dy = -1; dy <= 1; dy++) {  // Проходим по смещению по горизонтали
-            if (dx || dy) {  // Пропускаем центральную клетку (dx=0, dy=0)
-                int nx = (x + dx + HEIGHT) % HEIGHT;  // Координата соседа по вертикали с учётом замыкания
-                int ny = (y + dy + WIDTH) % WIDTH;  // Координата соседа по горизонтали с учётом замыкания
-                count += f[nx][ny];  // Прибавляем 1 если сосед жив
+// Публикуем текущее поколение: копируем его в back и меняем back со средним буфером
+void sim_publish(sim_state *s) {
+    triple_buffer *t = &s->frames;
+    field *f = engine_view(s->eng);
+
+    memcpy(t->slot[t->back]->cells, f->cells, (size_t)f->height * f->stride);
+    t->gen[t->back] = s->eng->generation;
+    t->stats[t->back] = *engine_stats(s->eng);
+    t->back = atomic_exchange_explicit(&t->middle, t->back | FRAME_FRESH, memory_order_acq_rel) & 3;
+}
+
+// Последнее опубликованное поколение: забираем средний буфер, если в нём новый кадр.
+// Промежуточные поколения, которые интерфейс не успел показать, просто пропускаются
+int sim_latest(triple_buffer *t) {
+    if (atomic_load_explicit(&t->middle, memory_order_acquire) & FRAME_FRESH) {
+        t->front = atomic_exchange_explicit(&t->middle, t->front, memory_order_acq_rel) & 3;
+    }
+    return t->front;
+}
+
+// Поток симуляции: считает поколения из budget отрезками не больше per_frame и публикует каждый отрезок
+void *sim_thread(void *arg) {
+    sim_state *s = arg;
+    const options *opt = s->opt;
+    struct timespec idle = {0, 200000};  // Пауза, когда считать нечего (0.2 мс)
+
+    while (!atomic_load(&s->stop)) {
+        uint64_t budget = atomic_load(&s->budget), step = atomic_load(&s->per_frame);
+        uint64_t before = s->eng->generation;
+        if (!budget) {
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        if (step > budget) step = budget;
+        if (s->eng->type == ENGINE_HASHLIFE || s->cycles.period) {  // Считаем отрезок целиком
+            if (!engine_advance(s->eng, step)) {
+                atomic_store(&s->failed, 1);
+                break;
+            }
+        } else {  // Пока цикл не найден, шагаем по одному поколению и хешируем каждое
+            for (uint64_t g = 0; g < step && !s->cycles.period; g++) {
+                int empty;
+                uint64_t hash;
+                s->eng->stats_last = g + 1 == step;  // Статистика нужна только кадру
+                engine_advance(s->eng, 1);
+                hash = engine_hash(s->eng, &empty);
+                if (cycle_check(&s->cycles, hash, empty, s->eng->generation)) {
+                    atomic_store(&s->period, s->cycles.period);  // found и empty уже записаны
+                }
             }
+            s->eng->stats_last = 1;
+            engine_advance(s->eng, before + step - s->eng->generation);  // Остаток после найденного цикла
         }
+        atomic_fetch_sub(&s->budget, step);
+        if (opt->checkpoint_every &&
+            s->eng->generation / opt->checkpoint_every != before / opt->checkpoint_every) {
+            // Перешли через границу периода. Неудачу (свою или предыдущей точки) покажет строка состояния
+            if (!checkpoint_save(s->ck, engine_view(s->eng), s->eng->generation)) {
+                atomic_store(&s->ck_failed, 1);
+            }
+        }
+        sim_publish(s);
     }
+    prof_release();
 
-    return count;  // Возвращаем число живых соседей
+    return NULL;
+}
+
+// Расписание кадров интерфейса: кадр k начинается в момент start + k * period по CLOCK_MONOTONIC,
+// так что время отрисовки и ввода не сдвигает следующие кадры. Кадр, закончившийся после своего срока,
+// считается пропущенным: расписание отсчитывается заново от текущего момента, без пачки догоняющих кадров
+typedef struct {
+    struct timespec deadline;      // Срок начала следующего кадра
+    long period;                   // Длительность кадра в наносекундах
+    double last;                   // Начало текущего кадра (now_seconds)
+    double times[FRAME_HISTORY];   // Длительности последних кадров в секундах, по кругу
+    int count;                     // Сколько из них заполнено
+    int next;                      // Куда ляжет следующая
+    uint64_t missed;               // Пропущенных сроков
+} frame_pacer;
+
+void pacer_start(frame_pacer *p, int rate) {
+    memset(p, 0, sizeof(*p));
+    p->period = 1000000000L / rate;
+    clock_gettime(CLOCK_MONOTONIC, &p->deadline);
+    p->last = now_seconds();
+}
+
+// Ждём срока следующего кадра и возвращаем длительность закончившегося кадра в секундах
+double pacer_wait(frame_pacer *p) {
+    struct timespec now;
+    double begin, elapsed;
+
+    p->deadline.tv_nsec += p->period;
+    if (p->deadline.tv_nsec >= 1000000000L) {
+        p->deadline.tv_nsec -= 1000000000L;
+        p->deadline.tv_sec++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > p->deadline.tv_sec ||
+        (now.tv_sec == p->deadline.tv_sec && now.tv_nsec > p->deadline.tv_nsec)) {  // Срок уже прошёл
+        p->missed++;
+        p->deadline = now;
+    } else {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &p->deadline, NULL) == EINTR) continue;
+    }
+    begin = now_seconds();
+    elapsed = begin - p->last;
+    p->last = begin;
+    p->times[p->next] = elapsed;
+    p->next = (p->next + 1) % FRAME_HISTORY;
+    if (p->count < FRAME_HISTORY) p->count++;
+
+    return elapsed;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Квантиль q длительности последних кадров в секундах (0 — кадров ещё не было)
+double pacer_percentile(const frame_pacer *p, double q) {
+    double sorted[FRAME_HISTORY];
+
+    if (!p->count) return 0;
+    memcpy(sorted, p->times, (size_t)p->count * sizeof(double));
+    qsort(sorted, (size_t)p->count, sizeof(double), compare_double);
+    return sorted[(int)(q * (p->count - 1) + 0.5)];
+}
+
+// Интерактивный режим: отрисовка в ncurses, управление клавишами A/Z/SPACE, стрелками и +/-
+int run_interactive(engine *eng, const options *opt, checkpoint *ck) {
+    // Возвращаем stdin обратно на терминал для обработки клавиатуры
+    if (!freopen("/dev/tty", "r", stdin)) {
+        fprintf(stderr, "Error: cannot reopen /dev/tty for stdin\n");
+        return 0;
+    }
+
+    initscr();  // Инициализируем ncurses
+    cbreak();  // Отключаем буферизацию ввода (символы принимаются сразу)
+    noecho();  // Не показываем вводимые символы на экране
+    keypad(stdscr, TRUE);  // Включаем поддержку клавиш стрелок и функциональных клавиш
+    nodelay(stdscr, TRUE);  // Делает getch() неблокирующим — не ждёт ввода
+    curs_set(0);            // Скрываем курсор
+
+    uint64_t target = (uint64_t)INIT_RATE << opt->jump;  // Цель скорости в поколениях в секунду (A/Z)
+    double credit = 0;       // Поколения, заработанные по цели, но ещё не заказанные симуляции
+    frame_pacer pacer;       // Сроки кадров и их длительности
+    int ch = ERR;            // Код последней нажатой клавиши
+    int stop = 0;            // Флаг для выхода из игрового цикла
+    view v = {0, 0, 1, 0, 0, NULL, NULL};  // Окно в левом верхнем углу без масштаба
+    sim_state s = {.eng = eng, .opt = opt, .ck = ck};
+    pthread_t sim;            // Поток симуляции
+    int started = 0;          // Поток симуляции запущен
+    uint64_t shown = eng->generation;  // Поколение на экране и момент его замера — для скорости
+    double shown_at = now_seconds(), rate = 0;
+    char info[256];           // Строка состояния симуляции
+
+    if (eng->type != ENGINE_HASHLIFE) {  // Начальное поколение — первое в поиске циклов
+        int empty;
+        uint64_t hash = engine_hash(eng, &empty);
+        if (cycle_check(&s.cycles, hash, empty, eng->generation)) s.period = s.cycles.period;
+    }
+    s.frames.middle = 1 | FRAME_FRESH;  // Начальное поколение сразу доступно интерфейсу
+    s.frames.back = 2;
+    s.per_frame = (uint64_t)1 << opt->jump;
+    for (int i = 0; i < 3; i++) {
+        s.frames.slot[i] = create_field(eng->curr->height, eng->curr->width);
+        stop |= !s.frames.slot[i];
+    }
+    if (!stop) {
+        field *f = engine_view(eng);
+        memcpy(s.frames.slot[1]->cells, f->cells, (size_t)f->height * f->stride);
+        s.frames.gen[1] = eng->generation;
+        s.frames.stats[1] = *engine_stats(eng);
+        eng->stats_last = 1;  // Каждый отрезок заканчивается поколением со статистикой для кадра
+        started = pthread_create(&sim, NULL, sim_thread, &s) == 0;
+        stop = !started;
+    }
+    pacer_start(&pacer, FRAME_RATE);
+
+    while (!stop) {  // Цикл интерфейса: FRAME_RATE кадров в секунду, симуляция идёт в своём потоке
+        int front = sim_latest(&s.frames);
+        double now = now_seconds();
+        if (now - shown_at >= 1.0 && s.frames.gen[front] != shown) {  // Скорость — не чаще раза в секунду
+            rate = (double)(s.frames.gen[front] - shown) / (now - shown_at);
+            shown = s.frames.gen[front];
+            shown_at = now;
+        }
+        uint64_t period = atomic_load(&s.period);
+        unsigned long long gen = s.frames.gen[front], found = period ? s.cycles.found : 0;
+        int len = snprintf(info, sizeof(info),
+                           "Gen %llu | %llu gens/step (S/X) | %.0f gens/s | frame p50 %.1f p99 %.1f ms, "
+                           "%llu missed", gen, (unsigned long long)atomic_load(&s.per_frame), rate,
+                           pacer_percentile(&pacer, 0.5) * 1e3, pacer_percentile(&pacer, 0.99) * 1e3,
+                           (unsigned long long)pacer.missed);
+        if (atomic_load(&s.failed)) {
+            snprintf(info + len, sizeof(info) - len, " | stopped: out of memory or pattern left the plane");
+        } else if (period && s.cycles.empty) {  // found и empty записаны до period и больше не меняются
+            snprintf(info + len, sizeof(info) - len, " | died at gen %llu", found);
+        } else if (period == 1) {
+            snprintf(info + len, sizeof(info) - len, " | still life since gen %llu", found - 1);
+        } else if (period) {
+            snprintf(info + len, sizeof(info) - len, " | period %llu since gen %llu",
+                     (unsigned long long)period, found - period);
+        }
+        if (atomic_load(&s.ck_failed)) {
+            len = (int)strlen(info);
+            snprintf(info + len, sizeof(info) - len, " | cannot write checkpoint %s", opt->checkpoint);
+        }
+        // Отрисовываем изменения поля, статистику и информацию
+        draw(&v, s.frames.slot[front], &s.frames.stats[front], target, ch, info);
+        ch = getch();                                     // Считываем клавишу (если нажата)
+
+        if (ch != ERR) {      // Если клавиша была нажата
+            uint64_t per_frame = atomic_load(&s.per_frame);
+            if (view_key(&v, s.frames.slot[front], ch)) {  // Стрелки и +/- двигают и масштабируют окно
+                continue;                                  // Перерисовываем без задержки
+            } else if (ch == ' ') {  // Если пробел — выходим из игры
+                stop = 1;
+            } else if (ch == 'a' || ch == 'A') {  // A — вдвое медленнее
+                if (target > 1) target /= 2;
+                credit = 0;
+            } else if (ch == 'z' || ch == 'Z') {  // Z — вдвое быстрее
+                if (target < MAX_RATE) target *= 2;
+            } else if (ch == 's' || ch == 'S') {  // S — вдвое меньше поколений на шаг
+                if (per_frame > 1) atomic_store(&s.per_frame, per_frame / 2);
+            } else if (ch == 'x' || ch == 'X') {  // X — вдвое больше поколений на шаг
+                if (per_frame < MAX_PER_FRAME) atomic_store(&s.per_frame, per_frame * 2);
+            }
+        }
+
+        // Ждём срока следующего кадра и заказываем поколения, заработанные по цели за прошедший кадр
+        // (по его настоящей длительности), целыми шагами S/X — Hashlife прыгает только на них. Заказ
+        // на кадр вперёд держит симуляцию занятой, пока она успевает; если не успевает, новый заказ
+        // не копится: интерфейс показывает то, что уже готово, а отставание не растёт
+        credit += (double)target * pacer_wait(&pacer);
+        uint64_t step = atomic_load(&s.per_frame);
+        double steps = credit / (double)step;
+        uint64_t order = (steps < (double)(MAX_RATE / step) ? (uint64_t)steps : MAX_RATE / step) * step;
+        credit -= (double)order;
+        if (atomic_load(&s.budget) < order) atomic_fetch_add(&s.budget, order);
+    }
+
+    atomic_store(&s.stop, 1);
+    if (started) pthread_join(sim, NULL);  // Дальше движком снова владеет главный поток
+    for (int i = 0; i < 3; i++) free_field(s.frames.slot[i]);
+    endwin();  // Завершаем работу с ncurses (восстанавливаем терминал)
+    free(v.prev);
+    if (!started) fprintf(stderr, "Cannot start simulation thread\n");
+
+    return started;
+}
+
+// Итоговое поле пакетного режима — в --output или stdout
+int headless_output(engine *eng, const options *opt) {
+    int success = 1;
+    prof_mark mark;
+    FILE *out;
+
+    prof_begin(&mark);
+    out = opt->output ? fopen(opt->output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Cannot open output file: %s\n", opt->output);
+        success = 0;
+    } else {
+        success = eng->type == ENGINE_DISK ? disk_write(eng->disk, out) : write_field(engine_view(eng), out);
+        if (out != stdout && fclose(out) != 0) success = 0;
+        if (!success) fprintf(stderr, "Error writing output\n");
+    }
+    prof_end(&mark, PHASE_WRITE);
+
+    return success;
 }
 
-// Вычисление следующего поколения клеток по правилам "Жизни"
-void next_gen(int **curr, int **next) {
-    for (int i = 0; i < HEIGHT; i++) {      // Для каждой строки
-        for (int j = 0; j < WIDTH; j++) {   // Для каждого столбца
-            int n = neighbors(curr, i, j);  // Считаем соседей у клетки (i,j)
-            // Клетка живёт, если у неё 2 или 3 соседа, или оживает, если у мёртвой 3 соседа
-            next[i][j] = (curr[i][j] && (n == 2 || n == 3)) || (!curr[i][j] && n == 3);
+// Пакетный режим: без ncurses и задержек считаем generations поколений и пишем итоговое поле.
+// С --checkpoint-every счёт идёт отрезками до каждого кратного периоду поколения. Движки, шагающие
+// по одному поколению, ищут циклы: найденный период p позволяет досчитать только (осталось) mod p поколений.
+// Hashlife прыгает через поколения, поэтому в нём циклы не ищутся. С потоком статистики досчёт по модулю
+// годится только для натюрморта (его статистика не меняется) — с периодом больше 1 поле считается честно,
+// но уже без хешей
+int run_headless(engine *eng, const options *opt, checkpoint *ck) {
+    int success = 1;
+    uint64_t target = eng->generation + (uint64_t)opt->generations;  // Последнее поколение счёта
+    cycle_finder cycles = {0};
+    // Доске на диске хеш каждого поколения стоил бы ещё одного чтения всего файла
+    int detect = eng->type != ENGINE_HASHLIFE && eng->type != ENGINE_DISK;
+    // С временными блоками поле хешируется раз в блок: поиск ведётся в блоках, а найденный период
+    // в блоках потом уточняется шагами по одному поколению
+    uint64_t block = (uint64_t)eng->temporal, start = eng->generation;
+
+    if (detect) {
+        int empty;
+        uint64_t hash = engine_hash(eng, &empty);
+        cycle_check(&cycles, hash, empty, 0);
+    }
+    while (success && eng->generation < target) {
+        uint64_t span = target - eng->generation;  // Поколений до конца счёта или до контрольной точки
+        // Дальше поле повторяется: досчитываем неполный период. Поток статистики и запись требуют
+        // каждого поколения, для них пропускается только натюрморт. Экспорту нужен каждый кадр
+        if (cycles.period && !eng->export && ((!eng->stream && !eng->record) || cycles.period == 1)) {
+            success = engine_advance(eng, span % cycles.period);
+            if (eng->record) record_same(eng->record, span);
+            if (eng->stream) {  // Натюрморт: те же клетки без рождений и смертей до конца счёта
+                uint64_t every = eng->stream->every;
+                gen_stats still = *engine_stats(eng);
+                still.births = still.deaths = 0;
+                for (uint64_t g = (eng->generation / every + 1) * every; g <= target; g += every) {
+                    stats_write(eng->stream, g, &still);
+                }
+            }
+            eng->generation = target;
+            break;
+        }
+        if (opt->checkpoint_every) {
+            uint64_t period = (uint64_t)opt->checkpoint_every;
+            if (period - eng->generation % period < span) span = period - eng->generation % period;
+        }
+        if (detect && !cycles.period && span > block) span = block;
+        success = engine_advance(eng, span);
+        if (success && detect && !cycles.period && (eng->generation - start) % block == 0) {
+            int empty;
+            uint64_t hash = engine_hash(eng, &empty);
+            if (cycle_check(&cycles, hash, empty, (eng->generation - start) / block)) {
+                cycles.found = eng->generation;
+            }
+            if (cycles.period && !cycles.empty && block > 1) {
+                uint64_t steps = 0, limit = cycles.period * block, again = ~hash;
+                while (success && again != hash && steps < limit && eng->generation < target) {
+                    success = engine_advance(eng, 1);  // Настоящий период делит период блоков
+                    again = engine_hash(eng, &empty);
+                    steps++;
+                }
+                cycles.period = again == hash ? steps : limit;
+            }
         }
+        if (success && eng->generation < target && opt->checkpoint_every &&
+            eng->generation % opt->checkpoint_every == 0) {
+            if (!checkpoint_save(ck, engine_view(eng), eng->generation)) return 0;  // Сообщит main
+        }
+    }
+    if (cycles.period) {
+        fprintf(stderr, cycles.empty ? "Board died at generation %llu\n"
+                                     : "Cycle detected at generation %llu, period %llu\n",
+                (unsigned long long)cycles.found, (unsigned long long)cycles.period);
+    }
+
+    if (!success) {
+        fprintf(stderr, "Simulation failed: out of memory or pattern left the plane\n");
+    } else {
+        success = headless_output(eng, opt);
+    }
+
+    return success;
+}
+
+// Ждём строку соседа: сначала крутимся, потом уступаем процессор, потом спим — рангов может быть
+// больше, чем ядер
+static void rank_wait(unsigned *spins) {
+    struct timespec pause = {0, 50000};  // 50 мкс
+
+    if (++*spins > 4096) {
+        nanosleep(&pause, NULL);
+    } else if (*spins > 64) {
+        sched_yield();
     }
 }
 
-// Очистка поля — делаем все клетки мёртвыми (0)
-void clear_field(int **f) {
-    for (int i = 0; i < HEIGHT; i++) {     // Для каждой строки
-        for (int j = 0; j < WIDTH; j++) {  // Для каждого столбца
-            f[i][j] = 0;                   // Обнуляем клетку
+// Отправляем строку в кольцо k (ждём, только если получатель отстал на RANK_SLOTS поколений)
+static void rank_send(rank_world *w, int k, const uint64_t *row) {
+    rank_ring *ring = &w->rings[k];
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned spins = 0;
+
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == RANK_SLOTS) rank_wait(&spins);
+    memcpy(w->slots + ((size_t)k * RANK_SLOTS + head % RANK_SLOTS) * w->words, row,
+           (size_t)w->words * sizeof(uint64_t));
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Забираем следующую строку из кольца k
+static void rank_recv(rank_world *w, int k, uint64_t *row) {
+    rank_ring *ring = &w->rings[k];
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned spins = 0;
+
+    while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) rank_wait(&spins);
+    memcpy(row, w->slots + ((size_t)k * RANK_SLOTS + tail % RANK_SLOTS) * w->words,
+           (size_t)w->words * sizeof(uint64_t));
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// Процесс-ранг r: держит только свою полосу с двумя строками-призраками (строка 0 — последняя строка
+// верхнего соседа, строка rows + 1 — первая нижнего). Каждое поколение: отдаём свои крайние строки
+// соседям, забираем их крайние строки в призраки, считаем полосу ядром битового движка. В конце
+// дожидаемся своей очереди и дописываем полосу в итоговое поле
+static int rank_main(rank_world *w, int r, uint64_t *curr, uint64_t gens) {
+    rank_timing *t = &w->timing[r];
+    int n = w->words, rows = t->last - t->first, success;
+    int up = (r + w->ranks - 1) % w->ranks, down = (r + 1) % w->ranks;  // Соседи по кругу
+    uint64_t *next = calloc((size_t)(rows + 2) * n, sizeof(uint64_t));
+    bitfield strip = {rows, w->width, n, w->tail, NULL};  // Полоса без призраков — для вывода
+    unsigned spins = 0;
+
+    if (!next) return 0;
+    for (uint64_t g = 0; g < gens; g++) {
+        double t0 = now_seconds(), t1;
+        rank_send(w, 2 * r + 1, curr + n);                         // Первая строка — верхнему соседу
+        rank_send(w, 2 * r, curr + (size_t)rows * n);              // Последняя — нижнему
+        rank_recv(w, 2 * up, curr);                                // Последняя строка верхнего соседа
+        rank_recv(w, 2 * down + 1, curr + (size_t)(rows + 1) * n);  // Первая строка нижнего
+        t1 = now_seconds();
+        for (int i = 1; i <= rows; i++) {
+            uint64_t *out = next + (size_t)i * n;
+            bits_row(curr + (size_t)(i - 1) * n, curr + (size_t)i * n, curr + (size_t)(i + 1) * n, out, n,
+                     w->width);
+            out[n - 1] &= w->tail;  // Биты за правым краем строки всегда мёртвые
         }
+        uint64_t *tmp = curr;
+        curr = next;
+        next = tmp;
+        t->exchange += t1 - t0;
+        t->compute += now_seconds() - t1;
+    }
+    free(next);
+    while (atomic_load_explicit(w->turn, memory_order_acquire) != r) rank_wait(&spins);
+    strip.bits = curr + n;
+    success = write_bits(&strip, w->out) && fflush(w->out) == 0;
+    if (success) {
+        atomic_store_explicit(w->turn, r + 1, memory_order_release);
+    } else {
+        fprintf(stderr, "Error writing output\n");
+    }
+
+    return success;
+}
+
+// Начальная полоса ранга: строки [t->first, t->last) входного файла в битах, со строками-призраками
+// сверху и снизу. Байтовое поле нужно только на полосу и сразу освобождается
+static uint64_t *rank_strip(const board_file *in, const rank_world *w, const rank_timing *t, int height,
+                            int exact) {
+    int rows = t->last - t->first;
+    field *f = create_field(rows, w->width);
+    uint64_t *bits = calloc((size_t)(rows + 2) * w->words, sizeof(uint64_t));
+    bitfield strip = {rows, w->width, w->words, w->tail, bits ? bits + w->words : NULL};
+
+    if (!f || !bits) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(bits);
+        bits = NULL;
+    } else if (!read_rows(in, f, height, t->first, exact)) {
+        fprintf(stderr, "Error reading field\n");
+        free(bits);
+        bits = NULL;
+    } else {
+        pack_field(f, &strip);
     }
+    free_field(f);
+    // Иначе куча оставит себе освободившуюся полосу, и каждый следующий ранг унаследует её при fork
+    malloc_trim(0);
+
+    return bits;
 }
 
-// Отрисовка игрового поля и информационной панели
-void draw(int **f, int speed, int ch) {
-    clear();  // Очищаем экран терминала
+// Пакетный режим на нескольких процессах: поле режется на горизонтальные полосы по числу рангов,
+// каждый ранг — отдельный процесс со своей полосой, края соседям уходят через кольца в общей памяти.
+// Родитель читает входной файл полоса за полосой и запускает ранг на каждой, так что поле целиком
+// не держит никто; итог ранги пишут сами, по очереди сверху вниз — в output.tmp, который заменяет
+// --output только после успеха (--output может быть и входным файлом, который ещё читается).
+// Родитель печатает замеры рангов
+int run_ranks(const board_file *in, const options *opt, int height, int width) {
+    rank_world w = {0};
+    char *tmp = NULL;  // Временный файл итога рядом с --output
+    int ranks = opt->ranks, words = (width + 63) / 64, success = ranks <= height, started = 0;
+    size_t rings = 2 * (size_t)ranks * sizeof(rank_ring);
+    size_t slots = 2 * (size_t)ranks * RANK_SLOTS * words * sizeof(uint64_t);
+    size_t timing = ((size_t)ranks * sizeof(rank_timing) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    pid_t pids[MAX_RANKS];
+    double begin = now_seconds(), elapsed;
+
+    if (!success) fprintf(stderr, "Board of %d rows cannot be split into %d ranks\n", height, ranks);
+    if (success) {
+        w.size = rings + slots + timing + CACHE_LINE;
+        w.base = mmap(NULL, w.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        success = w.base != MAP_FAILED;  // Анонимная память уже обнулена: кольца пусты, пишет ранг 0
+        if (!success) fprintf(stderr, "Cannot map shared memory for ranks\n");
+    }
+    if (success && opt->output) {
+        size_t len = strlen(opt->output);
+        tmp = malloc(len + 5);
+        if (tmp) {
+            memcpy(tmp, opt->output, len);
+            memcpy(tmp + len, ".tmp", 5);
+            w.out = fopen(tmp, "w");
+        }
+    } else if (success) {
+        w.out = stdout;
+    }
+    if (success) {
+        success = w.out != NULL;
+        if (!success) fprintf(stderr, "Cannot open output file: %s\n", opt->output);
+    }
+    if (success) {
+        w.ranks = ranks;
+        w.width = width;
+        w.words = words;
+        w.tail = width % 64 ? ((uint64_t)1 << (width % 64)) - 1 : ~(uint64_t)0;
+        w.rings = w.base;
+        w.slots = (uint64_t *)((char *)w.base + rings);
+        w.timing = (rank_timing *)((char *)w.base + rings + slots);
+        w.turn = (_Atomic int *)((char *)w.base + rings + slots + timing);
+        for (int r = 0; r < ranks; r++) {
+            w.timing[r].first = (int)((long long)height * r / ranks);
+            w.timing[r].last = (int)((long long)height * (r + 1) / ranks);
+        }
+        for (; started < ranks && success; started++) {
+            uint64_t *strip = rank_strip(in, &w, &w.timing[started], height, !opt->height);
+            success = strip != NULL;
+            if (!success) break;
+            fflush(NULL);  // Буферы stdio не должны уйти в вывод дважды — из родителя и из рангов
+            pids[started] = fork();
+            if (pids[started] == 0) _exit(rank_main(&w, started, strip, (uint64_t)opt->generations) ? 0 : 1);
+            free(strip);  // Полоса теперь у ранга
+            if (pids[started] < 0) {
+                fprintf(stderr, "Cannot start rank %d\n", started);
+                success = 0;
+                break;
+            }
+        }
+    }
+    // Ждём все ранги. Если один упал или не запустился, соседи навсегда застрянут в ожидании его строк —
+    // останавливаем всех
+    for (int r = 0; r < started && !success; r++) kill(pids[r], SIGKILL);
+    for (int left = started; left > 0; left--) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) break;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !success) {
+            if (success) fprintf(stderr, "Rank process %d failed\n", (int)pid);
+            success = 0;
+            for (int r = 0; r < started; r++) kill(pids[r], SIGKILL);
+        }
+    }
+    elapsed = now_seconds() - begin;
+    if (w.out && w.out != stdout && fclose(w.out) != 0 && success) {
+        fprintf(stderr, "Error writing output\n");
+        success = 0;
+    }
+    if (tmp && w.out && success && rename(tmp, opt->output) != 0) {
+        fprintf(stderr, "Error writing output\n");
+        success = 0;
+    }
+    if (tmp && w.out && !success) remove(tmp);
+    free(tmp);
 
-    for (int i = 0; i < HEIGHT; i++) {           // Проходим по строкам
-        for (int j = 0; j < WIDTH; j++) {        // Проходим по столбцам
-            mvaddch(i, j, f[i][j] ? 'O' : '.');  // Рисуем 'O' если клетка жива, иначе '.'
+    if (success) {
+        for (int r = 0; r < ranks; r++) {
+            const rank_timing *t = &w.timing[r];
+            double busy = t->compute + t->exchange;
+            fprintf(stderr, "Rank %d: rows %d..%d, compute %.3f s, exchange %.3f s (%.0f%%)\n", r, t->first,
+                    t->last - 1, t->compute, t->exchange, busy > 0 ? 100.0 * t->exchange / busy : 0.0);
         }
+        fprintf(stderr, "%d ranks: %lld generations in %.3f s\n", ranks, opt->generations, elapsed);
     }
+    if (w.base && w.base != MAP_FAILED) munmap(w.base, w.size);
 
-    // Выводим снизу строку с текущей задержкой и подсказкой по управлению
-    mvprintw(HEIGHT, 0, "Delay: %d us | Controls: A - slower, Z - faster, SPACE - exit", speed);
+    return success;
+}
 
-    // Выводим код и символ последней нажатой клавиши (если это печатный символ)
-    mvprintw(HEIGHT + 1, 0, "Last key: code = %3d, char = '%c'", ch, (ch >= 32 && ch <= 126) ? ch : ' ');
+// Пути a и b ведут к одному и тому же файлу (0, если какого-то из них ещё нет)
+static int same_file(const char *a, const char *b) {
+    struct stat sa, sb;
 
-    refresh();  // Обновляем экран, чтобы все изменения стали видны
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
 }
 
-// Задержка между кадрами в микросекундах (использует napms, работающий с миллисекундами)
-void delay(int microseconds) {
-    napms(microseconds / 1000);  // napms принимает миллисекунды, делим микросекунды на 1000
+// Выбираем правило: --rule, иначе правило из файла RLE или контрольной точки, иначе B3/S23.
+// Контрольная точка продолжается только по своему правилу
+int choose_rule(options *opt, const board_file *in) {
+    int success = 1;
+    char name[24], other[24];  // Правила в виде B3/S23 для сообщений
+
+    if (in->has_rule && !opt->rule_given) opt->rule = in->rule;
+    format_rule(&opt->rule, name);
+    format_rule(&in->rule, other);
+    if ((in->format == FORMAT_CHECKPOINT || in->format == FORMAT_DISK) &&
+        (in->rule.birth != opt->rule.birth || in->rule.survive != opt->rule.survive)) {
+        fprintf(stderr, "%s was made with rule %s, not %s\n",
+                in->format == FORMAT_DISK ? "Board file" : "Checkpoint", other, name);
+        success = 0;
+    } else if (!rule_supported(opt->engine, &opt->rule)) {
+        fprintf(stderr, "Rule %s has B0 and cannot run on the unbounded %s plane\n", name,
+                engine_names[opt->engine]);
+        success = 0;
+    } else {
+        rule_init(&opt->rule);  // Ядра правила выбираются до создания движка
+    }
+
+    return success;
 }
 
 // Главная функция программы
 int main(int argc, const char *argv[]) {
     int result = 0;     // Код результата, 0 — успех, иначе ошибка
-    int **curr = NULL;  // Текущее поколение игрового поля
-    int **next = NULL;  // Следующее поколение игрового поля
-
-    if (argc != 2) {  // Проверяем, что передан один аргумент — имя файла с начальными данными
-        fprintf(stderr, "Usage: %s <input_file>\n", argv[0]);  // Если нет — выводим подсказку
-        result = 1;                              // Устанавливаем код ошибки
-    } else if (!freopen(argv[1], "r", stdin)) {  // Перенаправляем stdin на файл с входными данными
-        fprintf(stderr, "Cannot open file: %s\n", argv[1]);  // Если открыть не удалось — ошибка
+    engine eng = {0};   // Движок расчёта вместе с полями поколений
+    options opt;        // Параметры запуска
+
+    board_file in = {0};  // Входной файл, отображённый в память
+    checkpoint ck = {0};  // Запись контрольных точек
+    stats_stream st = {0};  // Поток статистики поколений
+    recorder rec = {0};     // Запись эволюции
+    exporter exp = {0};     // Экспорт кадров
+
+    if (!parse_args(argc, argv, &opt)) {  // Проверяем аргументы — нужно имя файла с начальными данными
+        fprintf(stderr,
+                "Usage: %s [--engine ref|bits|simd|hashlife|tiles|halo|chunks|disk] [--disk file] "
+                "[--boundary torus|dead|reflect] [--size WxH] [--threads N] [--jump K] [--rule Bx/Sy] "
+                "[--generations N [--output file]] [--checkpoint file [--checkpoint-every N]] "
+                "[--stats file [--stats-every N]] [--record file [--keyframe-every N]] [--seek N] "
+                "[--export file.ppm|png|gif [--export-every N] [--scale N|1/N] [--export-threads N]] "
+                "[--ranks N] [--temporal-k K] [--profile file] <input_file>\n"
+                "       %s --bench [--engine E] [--threads N] [--temporal-k K] [--rule Bx/Sy] "
+                "[--profile file] [patterns_dir]\n"
+                "       %s --soup N [--seed S] [--threads N] [--rule Bx/Sy] [--output file] "
+                "[--profile file]\n",
+                argv[0], argv[0], argv[0]);  // Выводим подсказку
+        result = 1;                  // Устанавливаем код ошибки
+    } else if (opt.profile && !profile_open(opt.profile)) {  // Профиль фаз с трассой по интервалам
+        result = 1;
+    } else if (opt.bench) {          // Бенчмарк движков — без терминала
+        result = !run_bench(&opt);
+    } else if (opt.soup) {  // Поиск по случайным супам — тоже без терминала
+        result = !run_soup(&opt);
+    } else if (!open_board(opt.input, &in)) {  // Отображаем файл в память, определяем формат и размер
+        result = 1;
+    } else if (opt.seek >= 0 && !stream_seek(&in, (uint64_t)opt.seek)) {  // Поколение записи для старта
+        result = 1;
+    } else if (!choose_rule(&opt, &in)) {  // Правило из --rule, из файла или B3/S23
+        result = 1;
+    } else if (in.format == FORMAT_DISK &&
+               (opt.engine != ENGINE_DISK || (opt.disk && !same_file(opt.disk, opt.input)))) {
+        fprintf(stderr, "%s is a disk engine board: continue it in place with --engine disk\n", opt.input);
+        result = 1;
+    } else if (in.format != FORMAT_DISK && opt.disk && same_file(opt.disk, opt.input)) {
+        fprintf(stderr, "--disk %s is the input file: the board would overwrite the pattern\n", opt.disk);
         result = 1;
     } else {
-        curr = create_field();  // Выделяем память под текущее поколение
-        next = create_field();  // Выделяем память под следующее поколение
+        int exact = !opt.height;  // Размер не задан — поле 0/1 должно совпасть с файлом точно
+        int height, width;        // Размеры поля
+        int resume = in.format == FORMAT_DISK;  // Доска движка disk продолжается в своём же файле
+
+        int compact = in.format == FORMAT_RLE || in.format == FORMAT_CELLS;  // Узор ставится в центр поля
+        int stage_height, stage_width;  // Поле узора движка disk: файл 0/1 ложится в левый верхний угол
 
-        if (!curr || !next) {                              // Если память не выделилась
+        board_size(&in, &opt, &height, &width);
+        stage_height = in.height && in.height < height ? in.height : height;
+        stage_width = in.width && in.width < width ? in.width : width;
+        if (opt.ranks) {  // Ранги читают поле полосами — движок на всё поле не создаётся
+            result = !run_ranks(&in, &opt, height, width);
+        } else if (!engine_create(&eng, opt.engine, height, width, opt.threads, opt.boundary,
+                                  resume ? opt.input : opt.disk)) {
             fprintf(stderr, "Memory allocation error\n");  // Выводим ошибку
             result = 1;
-        } else if (!read_field(curr)) {  // Считываем начальное состояние поля
+        } else if (eng.type == ENGINE_DISK && eng.disk->resumed != resume) {  // Чужую доску не затираем
+            fprintf(stderr, "Board file %s already holds generation %llu: pass it as the input file to "
+                    "continue it, or remove it\n", opt.disk, (unsigned long long)eng.disk->generation);
+            result = 1;
+        } else if (!resume && (!engine_stage(&eng, stage_height, stage_width, compact) ||
+                               !engine_temporal(&eng, opt.temporal_k))) {
+            fprintf(stderr, "Memory allocation error\n");
+            result = 1;
+        } else if (!resume && !read_board(&in, eng.curr, exact)) {  // Считываем начальное состояние поля
             fprintf(stderr, "Error reading field\n");  // Ошибка при чтении
             result = 1;
+        } else if (!resume && !engine_load(&eng)) {  // Переносим начальное состояние во внутренний формат
+            fprintf(stderr, "Memory allocation error\n");
+            result = 1;
+        } else if (opt.stats &&
+                   !stats_open(&st, opt.stats, opt.stats_every ? (uint64_t)opt.stats_every : 1)) {
+            result = 1;
+        } else if (opt.record &&
+                   !record_open(&rec, opt.record, height, width,
+                                opt.keyframe_every ? (uint64_t)opt.keyframe_every : RECORD_KEYFRAME)) {
+            if (opt.stats) stats_close(&st);
+            result = 1;
+        } else if (opt.export && !export_open(&exp, &opt, height, width)) {
+            if (opt.stats) stats_close(&st);
+            if (opt.record) record_close(&rec);
+            result = 1;
         } else {
-            // Возвращаем stdin обратно на терминал для обработки клавиатуры
-            if (!freopen("/dev/tty", "r", stdin)) {
-                fprintf(stderr, "Error: cannot reopen /dev/tty for stdin\n");
-                free_field(curr);  // Освобождаем память перед выходом
-                free_field(next);
-                return 1;
-            }
-
-            initscr();  // Инициализируем ncurses
-            cbreak();  // Отключаем буферизацию ввода (символы принимаются сразу)
-            noecho();  // Не показываем вводимые символы на экране
-            keypad(stdscr, TRUE);  // Включаем поддержку клавиш стрелок и функциональных клавиш
-            nodelay(stdscr, TRUE);  // Делает getch() неблокирующим — не ждёт ввода
-            curs_set(0);            // Скрываем курсор
-
-            int speed = INIT_SPEED;  // Начальная скорость (задержка)
-            int ch = ERR;            // Код последней нажатой клавиши
-            int stop = 0;            // Флаг для выхода из игрового цикла
-
-            while (!stop) {             // Игровой цикл
-                draw(curr, speed, ch);  // Отрисовываем поле и информацию
-                ch = getch();           // Считываем клавишу (если нажата)
-
-                if (ch != ERR) {      // Если клавиша была нажата
-                    if (ch == ' ') {  // Если пробел — выходим из игры
-                        stop = 1;
-                    } else if (ch == 'a' || ch == 'A') {  // A — увеличить задержку (медленнее)
-                        if (speed < 1000000) speed += 50000;
-                    } else if (ch == 'z' || ch == 'Z') {  // Z — уменьшить задержку (быстрее)
-                        if (speed > 50000) speed -= 50000;
-                    }
+            eng.generation = in.generation;  // Восстановленная контрольная точка продолжает свой счёт
+            if (opt.record) {  // Запись начинается ключевым кадром исходного поколения
+                eng.record = &rec;
+                record_frame(&rec, engine_bits(&eng, rec.pack), eng.generation);
+            }
+            if (opt.export) {  // Экспорт начинается с исходного поколения, если оно кратно периоду
+                eng.export = &exp;
+                if (eng.generation % exp.every == 0) {
+                    export_frame(&exp, engine_bits(&eng, exp.pack), eng.generation);
                 }
-
-                delay(speed);          // Ждём заданное время между кадрами
-                next_gen(curr, next);  // Вычисляем следующее поколение
-
-                int **tmp = curr;  // Меняем указатели местами для переключения поколений
-                curr = next;
-                next = tmp;
-
-                clear_field(next);  // Очищаем поле для следующего поколения
             }
-
-            endwin();  // Завершаем работу с ncurses (восстанавливаем терминал)
+            ck.path = opt.checkpoint;
+            if (opt.stats) {  // Поток начинается с исходного поколения, если оно кратно периоду
+                eng.stream = &st;
+                if (eng.generation % st.every == 0) stats_write(&st, eng.generation, engine_stats(&eng));
+            }
+            if (opt.generations >= 0) {  // Пакетный режим — без терминала
+                result = !run_headless(&eng, &opt, &ck);
+            } else {
+                result = !run_interactive(&eng, &opt, &ck);
+            }
+            // Итоговая контрольная точка — после окончания счёта (или выхода по пробелу)
+            if (!result && opt.checkpoint && !checkpoint_save(&ck, engine_view(&eng), eng.generation)) {
+                result = 1;
+            }
+            if (opt.checkpoint && !checkpoint_wait(&ck)) {  // Любая из точек счёта или итоговая
+                fprintf(stderr, "Cannot write checkpoint: %s\n", opt.checkpoint);
+                result = 1;
+            }
+            if (opt.stats && !stats_close(&st)) result = 1;
+            if (opt.record && !record_close(&rec)) result = 1;
+            if (opt.export && !export_close(&exp)) result = 1;
         }
     }
 
-    if (curr) free_field(curr);  // Освобождаем память текущего поколения
-    if (next) free_field(next);  // Освобождаем память следующего поколения
+    close_board(&in);
+    checkpoint_free(&ck);
+    engine_free(&eng);  // Освобождаем память всех поколений
+    if (!profile_close()) result = 1;  // Сводка профиля — после всех фаз, включая итоговый вывод
 
     return result;  // Возвращаем код результата
 }
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Регрессия: с правилом B0 пустое поле на следующем шаге оживает, а не считается вымершим.
+# Запуск из корня репозитория: sh tests/b0_headless.sh
+set -e
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cc -O2 game.c -o "$dir/game" -lncurses -lpthread
+printf '0 0 0 0\n0 0 0 0\n0 0 0 0\n0 0 0 0\n' > "$dir/empty.txt"
+full='1 1 1 1
+1 1 1 1
+1 1 1 1
+1 1 1 1'
+zero='0 0 0 0
+0 0 0 0
+0 0 0 0
+0 0 0 0'
+status=0
+# check ENGINE RULE GENERATIONS EXPECTED
+check() {
+    got=$("$dir/game" --engine "$1" --rule "$2" --generations "$3" "$dir/empty.txt" 2>/dev/null | sed 's/ *$//')
+    if [ "$got" != "$4" ]; then
+        echo "FAIL: --engine $1 --rule $2 --generations $3"
+        status=1
+    fi
+}
+for engine in ref bits simd tiles halo; do
+    check $engine B0/S8 1 "$full"      # Пустое поле заполняется и дальше стоит
+    check $engine B0/S8 2 "$full"
+    check $engine B0/S 1 "$full"       # Полное и пустое поле чередуются с периодом 2
+    check $engine B0/S 2 "$zero"
+    check $engine B0/S 1000001 "$full"
+    check $engine B3/S23 5 "$zero"     # Без B0 пустое поле так и остаётся пустым
+done
+[ $status -eq 0 ] && echo "b0_headless: ok"
+exit $status